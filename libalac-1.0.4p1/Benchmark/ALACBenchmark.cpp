@@ -0,0 +1,390 @@
+/*
+	File:		ALACBenchmark.cpp
+
+	Contains:	Standalone encoder throughput benchmark and SIMD kernel verification.
+
+	Encodes a corpus of 16-bit stereo signals in 352-frame packets (the AirPlay packet size) once with the
+	portable scalar code and once for each SIMD level the processor supports, checks that every packet
+	is byte-for-byte identical to the scalar result and decodes back to the input, and reports packets per
+	second for the full encoder and for each kernel on its own.
+
+	Raw 16-bit little-endian stereo PCM files given on the command line are added to the built-in corpus.
+
+	Build (from this directory):
+		cl /O2 /EHsc /DLIB_COMPILE /I..\LibALAC ALACBenchmark.cpp ..\LibALAC\ag_dec.c ..\LibALAC\ag_enc.c
+			..\LibALAC\ALACBitUtilities.c ..\LibALAC\ALACCpu.c ..\LibALAC\ALACDecoder.cpp ..\LibALAC\ALACEncoder.cpp
+			..\LibALAC\dp_dec.c ..\LibALAC\dp_enc.c ..\LibALAC\EndianPortable.c ..\LibALAC\matrix_dec.c ..\LibALAC\matrix_enc.c
+		g++ -O2 -DLIB_COMPILE -idirafter ../LibALAC -o ALACBenchmark ALACBenchmark.cpp ../LibALAC/ag_*.c ../LibALAC/[A-Z]*.c ../LibALAC/d*.c ../LibALAC/m*.c
+			../LibALAC/ALACDecoder.cpp ../LibALAC/ALACEncoder.cpp
+*/
+
+#include "ALACAudioTypes.h"
+#include "ALACBitUtilities.h"
+#include "ALACCpu.h"
+#include "ALACDecoder.h"
+#include "ALACEncoder.h"
+#include "aglib.h"
+#include "dplib.h"
+#include "matrixlib.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const uint32_t	kFramesPerPacket = 352;
+	const uint32_t	kChannels = 2;
+	const uint32_t	kBytesPerFrame = kChannels * sizeof(int16_t);
+	const uint32_t	kSampleRate = 44100;
+	const double	kPi = 3.14159265358979323846;
+
+	struct Signal
+	{
+		std::string				name;
+		std::vector<int16_t>	samples;	// interleaved stereo, whole number of packets
+	};
+
+	typedef std::vector<std::vector<uint8_t> >	PacketList;
+
+	// small deterministic generator so every run and platform sees the same corpus
+	uint32_t sRandomState = 0x12345678;
+
+	int32_t nextRandom( int32_t range )
+	{
+		sRandomState = sRandomState * 1664525 + 1013904223;
+		return (int32_t)((sRandomState >> 8) % (uint32_t) range) - range / 2;
+	}
+
+	int16_t clip( double value )
+	{
+		return (int16_t)(value > 32767.0 ? 32767 : (value < -32768.0 ? -32768 : value));
+	}
+
+	Signal makeSignal( const char * name, uint32_t seconds, int kind )
+	{
+		Signal		signal;
+		uint32_t	frames = seconds * kSampleRate;
+
+		frames -= frames % kFramesPerPacket;
+		signal.name = name;
+		signal.samples.resize( frames * kChannels );
+
+		for ( uint32_t i = 0; i < frames; i++ )
+		{
+			const double	t = (double) i / kSampleRate;
+			double			l = 0.0, r = 0.0;
+
+			switch ( kind )
+			{
+				case 0:	// digital silence
+					break;
+				case 1:	// near silence, as between tracks
+					l = nextRandom( 5 );
+					r = nextRandom( 5 );
+					break;
+				case 2:	// sine sweep 20 Hz to 20 kHz, right channel slightly delayed
+					l = 16000.0 * sin( 2.0 * kPi * 20.0 * (pow( 1000.0, t / seconds ) - 1.0) * seconds / log( 1000.0 ) );
+					r = 16000.0 * sin( 2.0 * kPi * 20.0 * (pow( 1000.0, (t - 0.0005) / seconds ) - 1.0) * seconds / log( 1000.0 ) );
+					break;
+				case 3:	// music-like: decaying harmonic notes with a little noise
+				{
+					const double	note = 110.0 * pow( 2.0, (double)((i / 11025) % 24) / 12.0 );
+					const double	envelope = exp( -3.0 * (double)(i % 11025) / 11025.0 );
+
+					for ( int h = 1; h <= 6; h++ )
+					{
+						l += envelope * (9000.0 / h) * sin( 2.0 * kPi * note * h * t );
+						r += envelope * (7000.0 / h) * sin( 2.0 * kPi * note * h * t + 0.3 * h );
+					}
+					l += nextRandom( 64 );
+					r += nextRandom( 64 );
+					break;
+				}
+				case 4:	// full-scale white noise (escape packets)
+					l = nextRandom( 65536 );
+					r = nextRandom( 65536 );
+					break;
+				case 5:	// clipped square wave, identical channels
+					l = r = (fmod( t * 441.0, 1.0 ) < 0.5) ? 32767.0 : -32768.0;
+					break;
+			}
+
+			signal.samples[i * 2 + 0] = clip( l );
+			signal.samples[i * 2 + 1] = clip( r );
+		}
+
+		return signal;
+	}
+
+	bool loadSignal( const char * path, Signal & signal )
+	{
+		FILE *		file = fopen( path, "rb" );
+		int16_t		frame[kChannels];
+
+		if ( file == NULL )
+			return false;
+
+		signal.name = path;
+		signal.samples.clear();
+		while ( fread( frame, sizeof(frame), 1, file ) == 1 )
+		{
+			// file is little-endian; so is every processor the SIMD kernels run on
+			signal.samples.push_back( frame[0] );
+			signal.samples.push_back( frame[1] );
+		}
+		fclose( file );
+
+		signal.samples.resize( signal.samples.size() - signal.samples.size() % (kFramesPerPacket * kChannels) );
+		return !signal.samples.empty();
+	}
+
+	AudioFormatDescription inputFormat()
+	{
+		AudioFormatDescription	format;
+
+		memset( &format, 0, sizeof(format) );
+		format.mSampleRate = kSampleRate;
+		format.mFormatID = kALACFormatLinearPCM;
+		format.mFormatFlags = kALACFormatFlagIsSignedInteger | kALACFormatFlagIsPacked;
+		format.mBytesPerPacket = kBytesPerFrame;
+		format.mFramesPerPacket = 1;
+		format.mBytesPerFrame = kBytesPerFrame;
+		format.mChannelsPerFrame = kChannels;
+		format.mBitsPerChannel = 16;
+		return format;
+	}
+
+	AudioFormatDescription outputFormat()
+	{
+		AudioFormatDescription	format;
+
+		memset( &format, 0, sizeof(format) );
+		format.mSampleRate = kSampleRate;
+		format.mFormatID = kALACFormatAppleLossless;
+		format.mFormatFlags = 1;	// 16-bit source data
+		format.mFramesPerPacket = kFramesPerPacket;
+		format.mChannelsPerFrame = kChannels;
+		return format;
+	}
+
+	double secondsSince( const std::chrono::steady_clock::time_point & start )
+	{
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	}
+
+	// encodes every packet of every signal, optionally keeping the output
+	double encodeCorpus( const std::vector<Signal> & corpus, bool fastMode, std::vector<PacketList> * output )
+	{
+		AudioFormatDescription	inFormat = inputFormat();
+		AudioFormatDescription	outFormat = outputFormat();
+		// fast mode writes a whole compressed frame before falling back to escape, so allow the encoder's worst case (mMaxOutputBytes)
+		std::vector<uint8_t>	buffer( kFramesPerPacket * kChannels * ((10 + 32) / 8) + 1 );
+		double					elapsed = 0.0;
+
+		if ( output != NULL )
+			output->assign( corpus.size(), PacketList() );
+
+		for ( size_t s = 0; s < corpus.size(); s++ )
+		{
+			const Signal &		signal = corpus[s];
+			const size_t		packets = signal.samples.size() / (kFramesPerPacket * kChannels);
+			ALACEncoder			encoder;
+
+			encoder.SetFrameSize( kFramesPerPacket );
+			encoder.InitializeEncoder( outFormat );
+			encoder.SetFastMode( fastMode );
+
+			for ( size_t p = 0; p < packets; p++ )
+			{
+				int32_t		size = kFramesPerPacket * kBytesPerFrame;
+				const std::chrono::steady_clock::time_point	start = std::chrono::steady_clock::now();
+
+				encoder.Encode( inFormat, outFormat, (unsigned char *) &signal.samples[p * kFramesPerPacket * kChannels], &buffer[0], &size );
+				elapsed += secondsSince( start );
+
+				if ( output != NULL )
+					(*output)[s].push_back( std::vector<uint8_t>( buffer.begin(), buffer.begin() + size ) );
+			}
+		}
+
+		return elapsed;
+	}
+
+	size_t countPackets( const std::vector<Signal> & corpus )
+	{
+		size_t		packets = 0;
+
+		for ( size_t s = 0; s < corpus.size(); s++ )
+			packets += corpus[s].samples.size() / (kFramesPerPacket * kChannels);
+		return packets;
+	}
+
+	bool decodesToInput( const std::vector<Signal> & corpus, const std::vector<PacketList> & encoded )
+	{
+		AudioFormatDescription	outFormat = outputFormat();
+		std::vector<int16_t>	decoded( kFramesPerPacket * kChannels );
+
+		for ( size_t s = 0; s < corpus.size(); s++ )
+		{
+			ALACEncoder				encoder;
+			ALACDecoder				decoder;
+			std::vector<uint8_t>	cookie;
+			uint32_t				cookieSize;
+
+			encoder.SetFrameSize( kFramesPerPacket );
+			encoder.InitializeEncoder( outFormat );
+			cookieSize = encoder.GetMagicCookieSize( kChannels );
+			cookie.resize( cookieSize );
+			encoder.GetMagicCookie( &cookie[0], &cookieSize );
+			decoder.Init( &cookie[0], cookieSize );
+
+			for ( size_t p = 0; p < encoded[s].size(); p++ )
+			{
+				BitBuffer				bits;
+				uint32_t				frames = 0;
+				std::vector<uint8_t>	packet( encoded[s][p] );
+
+				// the decoder reads whole words, so give it a few bytes of slack past the packet
+				packet.resize( packet.size() + 8 );
+				BitBufferInit( &bits, &packet[0], (uint32_t) encoded[s][p].size() );
+				if ( decoder.Decode( &bits, (uint8_t *) &decoded[0], kFramesPerPacket, kChannels, &frames ) != ALAC_noErr
+					|| frames != kFramesPerPacket
+					|| memcmp( &decoded[0], &corpus[s].samples[p * kFramesPerPacket * kChannels], kFramesPerPacket * kBytesPerFrame ) != 0 )
+				{
+					printf( "  %s: packet %u does not decode to its input\n", corpus[s].name.c_str(), (unsigned) p );
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool matchesReference( const std::vector<Signal> & corpus, const std::vector<PacketList> & reference, const std::vector<PacketList> & encoded )
+	{
+		for ( size_t s = 0; s < corpus.size(); s++ )
+		{
+			for ( size_t p = 0; p < reference[s].size(); p++ )
+			{
+				if ( reference[s][p] != encoded[s][p] )
+				{
+					printf( "  %s: packet %u differs from scalar encoding\n", corpus[s].name.c_str(), (unsigned) p );
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// runs each kernel over the music-like signal the way EncodeStereo does for a full packet
+	void benchmarkKernels( const Signal & signal )
+	{
+		const size_t			packets = signal.samples.size() / (kFramesPerPacket * kChannels);
+		std::vector<int32_t>	u( kFramesPerPacket ), v( kFramesPerPacket ), pc( kFramesPerPacket );
+		std::vector<uint8_t>	bits( kFramesPerPacket * 8 );
+		int16_t					coefs4[4], coefs8[8];
+		double					mixTime = 0.0, pc4Time = 0.0, pc8Time = 0.0, agTime = 0.0;
+
+		init_coefs( coefs4, DENSHIFT_DEFAULT, 4 );
+		init_coefs( coefs8, DENSHIFT_DEFAULT, 8 );
+
+		for ( size_t p = 0; p < packets; p++ )
+		{
+			int16_t *		input = const_cast<int16_t *>( &signal.samples[p * kFramesPerPacket * kChannels] );
+			BitBuffer		bitstream;
+			AGParamRec		params;
+			uint32_t		numBits;
+			std::chrono::steady_clock::time_point	start;
+
+			start = std::chrono::steady_clock::now();
+			mix16( input, kChannels, &u[0], &v[0], kFramesPerPacket, 2, 1 );
+			mixTime += secondsSince( start );
+
+			start = std::chrono::steady_clock::now();
+			pc_block( &u[0], &pc[0], kFramesPerPacket, coefs4, 4, 17, DENSHIFT_DEFAULT );
+			pc4Time += secondsSince( start );
+
+			start = std::chrono::steady_clock::now();
+			pc_block( &u[0], &pc[0], kFramesPerPacket, coefs8, 8, 17, DENSHIFT_DEFAULT );
+			pc8Time += secondsSince( start );
+
+			BitBufferInit( &bitstream, &bits[0], (uint32_t) bits.size() );
+			set_ag_params( &params, MB0, PB0, KB0, kFramesPerPacket, kFramesPerPacket, MAX_RUN_DEFAULT );
+			start = std::chrono::steady_clock::now();
+			dyn_comp( &params, &pc[0], &bitstream, kFramesPerPacket, 17, &numBits );
+			agTime += secondsSince( start );
+		}
+
+		printf( "    mix16 %10.0f   pc_block(4) %10.0f   pc_block(8) %10.0f   dyn_comp %10.0f  packets/s\n",
+			packets / mixTime, packets / pc4Time, packets / pc8Time, packets / agTime );
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	std::vector<Signal>		corpus;
+	std::vector<PacketList>	reference[2];
+	const uint32_t			supported = ALACGetCpuFeatures();
+	const uint32_t			levels[] = { 0, kALACCpuSSE2, kALACCpuSSE2 | kALACCpuAVX2 };
+	const char *			levelNames[] = { "scalar", "SSE2", "SSE2+AVX2" };
+	bool					passed = true;
+
+	corpus.push_back( makeSignal( "silence", 2, 0 ) );
+	corpus.push_back( makeSignal( "near silence", 5, 1 ) );
+	corpus.push_back( makeSignal( "sine sweep", 10, 2 ) );
+	corpus.push_back( makeSignal( "music-like", 20, 3 ) );
+	corpus.push_back( makeSignal( "white noise", 5, 4 ) );
+	corpus.push_back( makeSignal( "square wave", 5, 5 ) );
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		Signal		signal;
+
+		if ( loadSignal( argv[i], signal ) )
+			corpus.push_back( signal );
+		else
+			printf( "skipping '%s': cannot read 16-bit stereo PCM\n", argv[i] );
+	}
+
+	printf( "%u packets of %u frames; processor supports%s%s%s\n", (unsigned) countPackets( corpus ), kFramesPerPacket,
+		(supported & kALACCpuSSE2) ? " SSE2" : "", (supported & kALACCpuAVX2) ? " AVX2" : "", supported ? "" : " no SIMD kernels" );
+
+	for ( size_t level = 0; level < sizeof(levels) / sizeof(levels[0]); level++ )
+	{
+		if ( (levels[level] & supported) != levels[level] )
+			continue;
+
+		ALACSetCpuFeatureMask( levels[level] );
+		printf( "%s:\n", levelNames[level] );
+
+		for ( int fast = 0; fast < 2; fast++ )
+		{
+			std::vector<PacketList>		encoded;
+			const double				elapsed = encodeCorpus( corpus, fast != 0, &encoded );
+			const char *				verdict;
+
+			if ( level == 0 )
+			{
+				reference[fast] = encoded;
+				verdict = decodesToInput( corpus, encoded ) ? "lossless" : "NOT LOSSLESS";
+			}
+			else
+			{
+				verdict = matchesReference( corpus, reference[fast], encoded ) ? "identical to scalar" : "DIFFERS FROM SCALAR";
+			}
+			passed = passed && (verdict[0] != 'N' && verdict[0] != 'D');
+
+			printf( "  %s encode %10.0f packets/s  (%s)\n", fast ? "fast" : "full", countPackets( corpus ) / elapsed, verdict );
+		}
+
+		benchmarkKernels( corpus[3] );
+	}
+
+	ALACSetCpuFeatureMask( kALACCpuAll );
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+/*
+	File:		ALACCpu.c
+	
+	Contains:	Run-time processor feature detection for selecting SIMD kernels.
+*/
+
+#include "ALACCpu.h"
+
+#if ALAC_X86_SIMD && !defined(_MSC_VER)
+	#include <cpuid.h>
+#endif
+
+static volatile int32_t		sCpuFeatures = -1;
+static volatile uint32_t	sCpuFeatureMask = kALACCpuAll;
+
+#if ALAC_X86_SIMD
+static uint64_t ALACReadXCR0( void )
+{
+#if defined(_MSC_VER)
+	return _xgetbv( 0 );
+#else
+	uint32_t	eax, edx;
+
+	__asm__ __volatile__ ( "xgetbv" : "=a" (eax), "=d" (edx) : "c" (0) );
+	return ((uint64_t) edx << 32) | eax;
+#endif
+}
+#endif
+
+static int32_t ALACDetectCpuFeatures( void )
+{
+	int32_t		features = 0;
+
+#if ALAC_X86_SIMD
+	uint32_t	maxLeaf, ecx1, edx1, ebx7;
+
+#if defined(_MSC_VER)
+	int			info[4];
+
+	__cpuid( info, 0 );
+	maxLeaf = (uint32_t) info[0];
+	__cpuid( info, 1 );
+	ecx1 = (uint32_t) info[2];
+	edx1 = (uint32_t) info[3];
+	ebx7 = 0;
+	if ( maxLeaf >= 7 )
+	{
+		__cpuidex( info, 7, 0 );
+		ebx7 = (uint32_t) info[1];
+	}
+#else
+	uint32_t	eax, ebx, ecx, edx;
+
+	maxLeaf = __get_cpuid_max( 0, 0 );
+	ecx1 = edx1 = ebx7 = 0;
+	if ( __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+	{
+		ecx1 = ecx;
+		edx1 = edx;
+	}
+	if ( maxLeaf >= 7 )
+	{
+		__cpuid_count( 7, 0, eax, ebx, ecx, edx );
+		ebx7 = ebx;
+	}
+#endif
+
+	if ( edx1 & (1u << 26) )
+		features |= kALACCpuSSE2;
+
+	// AVX2 also needs the OS to save the upper halves of the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+	if ( (ebx7 & (1u << 5)) && (ecx1 & (1u << 27)) && (ecx1 & (1u << 28)) && ((ALACReadXCR0() & 6) == 6) )
+		features |= kALACCpuAVX2;
+#endif
+
+	return features;
+}
+
+uint32_t ALACGetCpuFeatures( void )
+{
+	// detection gives the same answer on every thread, so a racing first call is harmless
+	if ( sCpuFeatures < 0 )
+		sCpuFeatures = ALACDetectCpuFeatures();
+
+	return (uint32_t) sCpuFeatures & sCpuFeatureMask;
+}
+
+void ALACSetCpuFeatureMask( uint32_t mask )
+{
+	sCpuFeatureMask = mask;
+}
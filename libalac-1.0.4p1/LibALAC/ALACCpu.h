@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+/*
+	File:		ALACCpu.h
+	
+	Contains:	Run-time processor feature detection for selecting SIMD kernels, and bit scan helpers.
+*/
+
+#ifndef __ALACCPU_H
+#define __ALACCPU_H
+
+#include <stdint.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define ALAC_X86_SIMD	1
+#else
+	#define ALAC_X86_SIMD	0
+#endif
+
+#if ALAC_X86_SIMD
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#endif
+	#include <immintrin.h>
+#endif
+
+// kernels built for newer instruction sets than the compiler targets by default must say so with GCC/Clang;
+// MSVC accepts the intrinsics anywhere and leaves it to the caller to check the processor first
+#if ALAC_X86_SIMD && (defined(__GNUC__) || defined(__clang__))
+	#define ALAC_TARGET_SSE2	__attribute__((target("sse2")))
+	#define ALAC_TARGET_AVX2	__attribute__((target("avx2")))
+#else
+	#define ALAC_TARGET_SSE2
+	#define ALAC_TARGET_AVX2
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+	kALACCpuSSE2	= 1 << 0,
+	kALACCpuAVX2	= 1 << 1,
+	kALACCpuAll		= kALACCpuSSE2 | kALACCpuAVX2
+};
+
+// returns the kALACCpu flags that are both supported and allowed by the feature mask
+uint32_t	ALACGetCpuFeatures( void );
+
+// restricts which SIMD kernels may be used (e.g. 0 for the portable scalar code); default is kALACCpuAll
+void		ALACSetCpuFeatureMask( uint32_t mask );
+
+#ifdef __cplusplus
+}
+#endif
+
+// number of leading zero bits, 32 for zero
+static __inline int32_t ALACCountLeadingZeros( uint32_t value )
+{
+#if defined(_MSC_VER)
+	unsigned long	index;
+
+	return _BitScanReverse( &index, value ) ? (int32_t)(31 - index) : 32;
+#elif defined(__GNUC__) || defined(__clang__)
+	return (value != 0) ? __builtin_clz( value ) : 32;
+#else
+	int32_t			count = 0;
+
+	while ( count < 32 && (value & (0x80000000u >> count)) == 0 )
+		count++;
+	return count;
+#endif
+}
+
+#endif	/* __ALACCPU_H */
@@ -29,6 +29,7 @@
 #include "aglib.h"
 #include "ALACBitUtilities.h"
 #include "ALACAudioTypes.h"
+#include "ALACCpu.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -92,16 +93,7 @@ void set_ag_params(AGParamRecPtr params, uint32_t m, uint32_t p, uint32_t k, uin
 // note: implementing this with some kind of "count leading zeros" assembly is a big performance win
 static __inline int32_t lead( int32_t m )
 {
-	long j;
-	unsigned long c = (1ul << 31);
-
-	for(j=0; j < 32; j++)
-	{
-		if((c & m) != 0)
-			break;
-		c >>= 1;
-	}
-	return (j);
+	return ALACCountLeadingZeros( (uint32_t) m );
 }
 
 #define arithmin(a, b) ((a) < (b) ? (a) : (b))
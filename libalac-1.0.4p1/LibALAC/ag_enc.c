@@ -30,6 +30,7 @@
 #include "ALACBitUtilities.h"
 #include "EndianPortable.h"
 #include "ALACAudioTypes.h"
+#include "ALACCpu.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -65,16 +66,7 @@
 #if LIB_COMPILE
 static __inline int32_t lead( int32_t m )
 {
-	long j;
-	unsigned long c = (1ul << 31);
-
-	for(j=0; j < 32; j++)
-	{
-		if((c & m) != 0)
-			break;
-		c >>= 1;
-	}
-	return (j);
+	return ALACCountLeadingZeros( (uint32_t) m );
 }
 
 #define arithmin(a, b) ((a) < (b) ? (a) : (b))
@@ -188,72 +180,70 @@ codeasescape:
 }
 
 
-static __inline void ALWAYS_INLINE dyn_jam_noDeref(unsigned char *out, uint32_t bitPos, uint32_t numBits, uint32_t value)
+/*
+	Codes are gathered most significant bit first in a 64-bit register and stored a 32-bit word at a time,
+	instead of reading and rewriting the output word for every code (which also defeats store forwarding
+	because consecutive codes land on overlapping, differently aligned words).
+*/
+typedef struct BitAccumulator
 {
-	uint32_t	*i = (uint32_t *)(out + (bitPos >> 3));
-	uint32_t	mask;
-	uint32_t	curr;
-	uint32_t	shift;
+	uint8_t *	out;
+	uint64_t	bits;
+	uint32_t	count;
+} BitAccumulator;
 
-	//Assert( numBits <= 32 );
+static __inline void ALWAYS_INLINE dyn_acc_init( BitAccumulator * acc, uint8_t * out, uint32_t bitPos )
+{
+	// pick up the bits already written to a partial first byte
+	acc->out = out + (bitPos >> 3);
+	acc->count = bitPos & 7;
+	acc->bits = (acc->count != 0) ? (acc->out[0] >> (8 - acc->count)) : 0;
+}
 
-	curr = *i;
-	curr = Swap32NtoB( curr );
+static __inline void ALWAYS_INLINE dyn_acc_put( BitAccumulator * acc, uint32_t numBits, uint32_t value )
+{
+	uint32_t	word;
 
-	shift = 32 - (bitPos & 7) - numBits;
+	//Assert( numBits <= 32 );
 
-	mask = ~0u >> (32 - numBits);		// mask must be created in two steps to avoid compiler sequencing ambiguity
-	mask <<= shift;
+	acc->bits = (acc->bits << numBits) | (value & (0xffffffffu >> (32 - numBits)));
+	acc->count += numBits;
 
-	value  = (value << shift) & mask;
-	value |= curr & ~mask;
-	
-	*i = Swap32BtoN( value );
+	if ( acc->count >= 32 )
+	{
+		acc->count -= 32;
+		word = (uint32_t)(acc->bits >> acc->count);
+
+		acc->out[0] = (uint8_t)(word >> 24);
+		acc->out[1] = (uint8_t)(word >> 16);
+		acc->out[2] = (uint8_t)(word >> 8);
+		acc->out[3] = (uint8_t) word;
+		acc->out += 4;
+	}
 }
 
-
-static __inline void ALWAYS_INLINE dyn_jam_noDeref_large(unsigned char *out, uint32_t bitPos, uint32_t numBits, uint32_t value)
+static __inline void ALWAYS_INLINE dyn_acc_flush( BitAccumulator * acc )
 {
-	uint32_t *	i = (uint32_t *)(out + (bitPos>>3));
-	uint32_t	w;
-	uint32_t	curr;
-	uint32_t	mask;
-	int32_t			shiftvalue = (32 - (bitPos&7) - numBits);
-	
-	//Assert(numBits <= 32);
+	uint32_t	keep;
 
-	curr = *i;
-	curr = Swap32NtoB( curr );
-
-	if (shiftvalue < 0)
+	while ( acc->count >= 8 )
 	{
-		uint8_t 	tailbyte;
-		uint8_t 	*tailptr;
-
-		w = value >> -shiftvalue;
-		mask = ~0u >> -shiftvalue;
-		w |= (curr & ~mask);
-
-		tailptr = ((uint8_t *)i) + 4;
-		tailbyte = (value << ((8+shiftvalue))) & 0xff;
-		*tailptr = (uint8_t)tailbyte;
+		acc->count -= 8;
+		*acc->out++ = (uint8_t)(acc->bits >> acc->count);
 	}
-	else
-	{
-		mask = ~0u >> (32 - numBits);
-		mask <<= shiftvalue;			// mask must be created in two steps to avoid compiler sequencing ambiguity
 
-		w  = (value << shiftvalue) & mask;
-		w |= curr & ~mask;
+	// leave the remaining bits of a partial last byte as they were, like the word-wise writes did
+	if ( acc->count != 0 )
+	{
+		keep = 8 - acc->count;
+		acc->out[0] = (uint8_t)((acc->bits << keep) | (acc->out[0] & ((1u << keep) - 1)));
 	}
-	
-	*i = Swap32BtoN( w );
 }
 
 
 int32_t dyn_comp( AGParamRecPtr params, int32_t * pc, BitBuffer * bitstream, int32_t numSamples, int32_t bitSize, uint32_t * outNumBits )
 {
-    unsigned char *		out;
+    BitAccumulator		acc;
     uint32_t		bitPos, startPos;
     uint32_t			m, k, n, c, mz, nz;
     uint32_t		numBits;
@@ -272,9 +262,9 @@ int32_t dyn_comp( AGParamRecPtr params, int32_t * pc, BitBuffer * bitstream, int
 	*outNumBits = 0;
 	RequireAction( (bitSize >= 1) && (bitSize <= 32), return kALAC_ParamError; );
 
-	out = bitstream->cur;
 	startPos = bitstream->bitIndex;
     bitPos = startPos;
+	dyn_acc_init( &acc, bitstream->cur, startPos );
 
     mb = params->mb = params->mb0;
     pb = params->pb;
@@ -303,14 +293,14 @@ int32_t dyn_comp( AGParamRecPtr params, int32_t * pc, BitBuffer * bitstream, int
 
 		if ( dyn_code_32bit(bitSize, m, k, n, &numBits, &value, &overflow, &overflowbits) )
 		{
-			dyn_jam_noDeref(out, bitPos, numBits, value);
+			dyn_acc_put(&acc, numBits, value);
 			bitPos += numBits;			
-			dyn_jam_noDeref_large(out, bitPos, overflowbits, overflow);			
+			dyn_acc_put(&acc, overflowbits, overflow);			
 			bitPos += overflowbits;
 		}
 		else
 		{
-			dyn_jam_noDeref(out, bitPos, numBits, value);
+			dyn_acc_put(&acc, numBits, value);
 			bitPos += numBits;
 		}
       
@@ -359,13 +349,15 @@ int32_t dyn_comp( AGParamRecPtr params, int32_t * pc, BitBuffer * bitstream, int
             mz = ((1<<k)-1) & wb;
 
             value = dyn_code(mz, k, nz, &numBits);
-            dyn_jam_noDeref(out, bitPos, numBits, value);
+            dyn_acc_put(&acc, numBits, value);
             bitPos += numBits;
 
             mb = 0;
         }
     }
 
+	dyn_acc_flush( &acc );
+
     *outNumBits = (bitPos - startPos);
 	BitBufferAdvance( bitstream, *outNumBits );
 
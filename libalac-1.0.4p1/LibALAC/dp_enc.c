@@ -27,6 +27,7 @@
 */
 
 #include "dplib.h"
+#include "ALACCpu.h"
 #include <string.h>
 
 #if __GNUC__
@@ -71,6 +72,91 @@ static __inline int32_t ALWAYS_INLINE sign_of_int( int32_t i )
     return negishift | (i >> 31);
 }
 
+#if ALAC_X86_SIMD
+/*
+	pc_block8_avx2()
+	- numactive == 8 predictor with all eight taps in one vector (lane i holds coefs[7 - i] and in[j - 8 + i])
+	- the sign-sign coefficient update in the scalar code walks the taps oldest first and stops once the
+	  weighted error crosses zero; since every step moves the error the same way, a tap is updated iff no
+	  earlier tap crossed, which is an exclusive prefix sum plus a prefix OR across the lanes
+	- the prefix sums only depend on the input, so they are worked out ahead of the coefficient feedback
+	- coefficients are kept as 32-bit lanes but wrapped to 16 bits after each update like the scalar code
+*/
+static ALAC_TARGET_AVX2 void pc_block8_avx2( int32_t * in, int32_t * pc1, int32_t num, int16_t * coefs, uint32_t chanbits, uint32_t denshift )
+{
+	const uint32_t	chanshift = 32 - chanbits;
+	const int32_t	denhalf = 1 << (denshift - 1);
+	const __m256i	zero = _mm256_setzero_si256();
+	const __m256i	ones = _mm256_set1_epi32( -1 );
+	const __m256i	weights = _mm256_setr_epi32( 1, 2, 3, 4, 5, 6, 7, 8 );
+	const __m256i	lane3 = _mm256_set1_epi32( 3 );
+	const __m128i	shift = _mm_cvtsi32_si128( (int) denshift );
+	__m256i			a;
+	int32_t			lanes[8];
+	int32_t			j;
+
+	a = _mm256_setr_epi32( coefs[7], coefs[6], coefs[5], coefs[4], coefs[3], coefs[2], coefs[1], coefs[0] );
+
+	for ( j = 9; j < num; j++ )
+	{
+		const int32_t	top = in[j - 9];
+		const __m256i	b = _mm256_sub_epi32( _mm256_set1_epi32( top ), _mm256_loadu_si256( (const __m256i *) &in[j - 8] ) );
+		__m256i			sgn, tpos, tneg, epos, eneg, prod, f;
+		__m128i			sum;
+		int32_t			del;
+
+		// weighted tap terms for a positive and a negative error, and their exclusive prefix sums
+		sgn = _mm256_sub_epi32( _mm256_cmpgt_epi32( zero, b ), _mm256_cmpgt_epi32( b, zero ) );
+		tpos = _mm256_abs_epi32( b );
+		tneg = _mm256_mullo_epi32( weights, _mm256_sra_epi32( _mm256_sub_epi32( zero, tpos ), shift ) );
+		tpos = _mm256_mullo_epi32( weights, _mm256_sra_epi32( tpos, shift ) );
+
+		epos = _mm256_add_epi32( tpos, _mm256_slli_si256( tpos, 4 ) );
+		epos = _mm256_add_epi32( epos, _mm256_slli_si256( epos, 8 ) );
+		epos = _mm256_add_epi32( epos, _mm256_permute2x128_si256( _mm256_permutevar8x32_epi32( epos, lane3 ), epos, 0x08 ) );
+		epos = _mm256_sub_epi32( epos, tpos );
+
+		eneg = _mm256_add_epi32( tneg, _mm256_slli_si256( tneg, 4 ) );
+		eneg = _mm256_add_epi32( eneg, _mm256_slli_si256( eneg, 8 ) );
+		eneg = _mm256_add_epi32( eneg, _mm256_permute2x128_si256( _mm256_permutevar8x32_epi32( eneg, lane3 ), eneg, 0x08 ) );
+		eneg = _mm256_sub_epi32( eneg, tneg );
+
+		// prediction
+		prod = _mm256_mullo_epi32( a, b );
+		sum = _mm_add_epi32( _mm256_castsi256_si128( prod ), _mm256_extracti128_si256( prod, 1 ) );
+		sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, 0x4E ) );
+		sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, 0xB1 ) );
+
+		del = in[j] - top - ((denhalf - _mm_cvtsi128_si32( sum )) >> denshift);
+		del = (del << chanshift) >> chanshift;
+		pc1[j] = del;
+
+		if ( del == 0 )
+			continue;
+
+		// lanes whose running error has not yet crossed zero, then block every lane after the first that has
+		if ( del > 0 )
+			f = _mm256_cmpgt_epi32( _mm256_sub_epi32( _mm256_set1_epi32( del ), epos ), zero );
+		else
+			f = _mm256_cmpgt_epi32( zero, _mm256_sub_epi32( _mm256_set1_epi32( del ), eneg ) );
+		f = _mm256_xor_si256( f, ones );
+		f = _mm256_or_si256( f, _mm256_slli_si256( f, 4 ) );
+		f = _mm256_or_si256( f, _mm256_slli_si256( f, 8 ) );
+		f = _mm256_or_si256( f, _mm256_permute2x128_si256( _mm256_permutevar8x32_epi32( f, lane3 ), f, 0x08 ) );
+
+		sgn = _mm256_andnot_si256( f, sgn );
+		a = (del > 0) ? _mm256_sub_epi32( a, sgn ) : _mm256_add_epi32( a, sgn );
+		a = _mm256_srai_epi32( _mm256_slli_epi32( a, 16 ), 16 );
+	}
+
+	_mm256_storeu_si256( (__m256i *) lanes, a );
+	_mm256_zeroupper();
+
+	for ( j = 0; j < 8; j++ )
+		coefs[j] = (int16_t) lanes[7 - j];
+}
+#endif
+
 void pc_block( int32_t * in, int32_t * pc1, int32_t num, int16_t * coefs, int32_t numactive, uint32_t chanbits, uint32_t denshift )
 {
 	register int16_t	a0, a1, a2, a3;
@@ -193,6 +279,13 @@ void pc_block( int32_t * in, int32_t * pc1, int32_t num, int16_t * coefs, int32_
 	}
 	else if ( numactive == 8 )
 	{
+#if ALAC_X86_SIMD
+		if ( ALACGetCpuFeatures() & kALACCpuAVX2 )
+		{
+			pc_block8_avx2( in, pc1, num, coefs, chanbits, denshift );
+			return;
+		}
+#endif
 		// optimization for numactive == 8
 		register int16_t	a4, a5, a6, a7;
 		register int32_t	b4, b5, b6, b7;
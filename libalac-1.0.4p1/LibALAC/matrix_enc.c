@@ -28,6 +28,7 @@
 
 #include "matrixlib.h"
 #include "ALACAudioTypes.h"
+#include "ALACCpu.h"
 
 // up to 24-bit "offset" macros for the individual bytes of a 20/24-bit word
 #if TARGET_RT_BIG_ENDIAN
@@ -57,11 +58,46 @@
 
 // 16-bit routines
 
+#if ALAC_X86_SIMD
+// interleaved stereo only: each (l, r) pair is one 32-bit lane, so pmaddwd forms both the matrixed
+// sum and the difference exactly; separated stereo is the same thing with (1, 0) and (0, 1) weights
+static ALAC_TARGET_SSE2 int32_t mix16_sse2( int16_t * in, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+{
+	const int32_t	m2 = (1 << mixbits) - mixres;
+	const __m128i	uWeights = (mixres != 0) ? _mm_set1_epi32( (int32_t)((uint32_t)(uint16_t) m2 << 16 | (uint16_t) mixres ) ) : _mm_set1_epi32( 1 );
+	const __m128i	vWeights = (mixres != 0) ? _mm_set1_epi32( (int32_t) 0xFFFF0001 ) : _mm_set1_epi32( 1 << 16 );
+	const __m128i	uShift = _mm_cvtsi32_si128( (mixres != 0) ? mixbits : 0 );
+	int32_t			j;
+
+	for ( j = 0; j + 4 <= numSamples; j += 4 )
+	{
+		const __m128i	lr = _mm_loadu_si128( (const __m128i *) &in[j * 2] );
+
+		_mm_storeu_si128( (__m128i *) &u[j], _mm_sra_epi32( _mm_madd_epi16( lr, uWeights ), uShift ) );
+		_mm_storeu_si128( (__m128i *) &v[j], _mm_madd_epi16( lr, vWeights ) );
+	}
+
+	return j;
+}
+#endif
+
 void mix16( int16_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
 {
 	int16_t	*	ip = in;
 	int32_t			j;
 
+#if ALAC_X86_SIMD
+	if ( (stride == 2) && (ALACGetCpuFeatures() & kALACCpuSSE2) )
+	{
+		// vector loop leaves any remainder for the scalar loops below
+		j = mix16_sse2( in, u, v, numSamples, mixbits, mixres );
+		ip += j * stride;
+		u += j;
+		v += j;
+		numSamples -= j;
+	}
+#endif
+
 	if ( mixres != 0 )
 	{
 		int32_t		mod = 1 << mixbits;
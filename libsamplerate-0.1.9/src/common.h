@@ -110,6 +110,9 @@ typedef struct SRC_PRIVATE_tag
 	/* State reset. */
 	void	(*reset) (struct SRC_PRIVATE_tag *psrc) ;
 
+	/* Release of anything private_data points to (optional). */
+	void	(*close) (struct SRC_PRIVATE_tag *psrc) ;
+
 	/* Data specific to SRC_MODE_CALLBACK. */
 	src_callback_t	callback_func ;
 	void			*user_callback_data ;
@@ -123,6 +126,14 @@ const char* sinc_get_description (int src_enum) ;
 
 int sinc_set_converter (SRC_PRIVATE *psrc, int src_enum) ;
 
+void sinc_get_coeffs (int src_enum, const float **coeffs, int *half_len, int *increment) ;
+
+/* In src_poly.c */
+const char* poly_get_name (int src_enum) ;
+const char* poly_get_description (int src_enum) ;
+
+int poly_set_converter (SRC_PRIVATE *psrc, int src_enum) ;
+
 /* In src_linear.c */
 const char* linear_get_name (int src_enum) ;
 const char* linear_get_description (int src_enum) ;
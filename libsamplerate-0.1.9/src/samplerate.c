@@ -84,7 +84,9 @@ src_delete (SRC_STATE *state)
 
 	psrc = (SRC_PRIVATE*) state ;
 	if (psrc)
-	{	if (psrc->private_data)
+	{	if (psrc->close)
+			psrc->close (psrc) ;
+		if (psrc->private_data)
 			free (psrc->private_data) ;
 		memset (psrc, 0, sizeof (SRC_PRIVATE)) ;
 		free (psrc) ;
@@ -325,6 +327,9 @@ src_get_name (int converter_type)
 	if ((desc = linear_get_name (converter_type)) != NULL)
 		return desc ;
 
+	if ((desc = poly_get_name (converter_type)) != NULL)
+		return desc ;
+
 	return NULL ;
 } /* src_get_name */
 
@@ -341,6 +346,9 @@ src_get_description (int converter_type)
 	if ((desc = linear_get_description (converter_type)) != NULL)
 		return desc ;
 
+	if ((desc = poly_get_description (converter_type)) != NULL)
+		return desc ;
+
 	return NULL ;
 } /* src_get_description */
 
@@ -535,6 +543,9 @@ psrc_set_converter (SRC_PRIVATE	*psrc, int converter_type)
 	if (linear_set_converter (psrc, converter_type) == SRC_ERR_NO_ERROR)
 		return SRC_ERR_NO_ERROR ;
 
+	if (poly_set_converter (psrc, converter_type) == SRC_ERR_NO_ERROR)
+		return SRC_ERR_NO_ERROR ;
+
 	return SRC_ERR_BAD_CONVERTER ;
 } /* psrc_set_converter */
 
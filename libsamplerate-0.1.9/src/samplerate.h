@@ -161,6 +161,7 @@ enum
 	SRC_SINC_FASTEST			= 2,
 	SRC_ZERO_ORDER_HOLD			= 3,
 	SRC_LINEAR					= 4,
+	SRC_SINC_POLYPHASE			= 5,
 } ;
 
 /*
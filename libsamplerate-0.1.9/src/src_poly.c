@@ -0,0 +1,474 @@
+/*
+** Copyright (c) 2002-2016, Erik de Castro Lopo <erikd@mega-nerd.com>
+** All rights reserved.
+**
+** This code is released under 2-clause BSD license. Please see the
+** file at : https://github.com/erikd/libsamplerate/blob/master/COPYING
+*/
+
+/*
+**	Fixed ratio polyphase version of the medium quality sinc interpolator.
+**
+**	When the conversion ratio is a fraction L/M with a small L (147/160 for
+**	48000 -> 44100 Hz, 147/320 for 96000 -> 44100 Hz, 1/2 for 88200 -> 44100 Hz)
+**	every output sample falls on one of only L positions between two input
+**	samples. The interpolated filter coefficients for each of those phases are
+**	calculated once, leaving a plain single precision dot product per output
+**	sample and channel. Any other ratio, or a ratio that changes while the
+**	stream is running, is handed to the SRC_SINC_MEDIUM_QUALITY converter.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "float_cast.h"
+#include "common.h"
+
+#if defined (__SSE__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 1)
+#define	POLY_USE_SSE	1
+#include <xmmintrin.h>
+#else
+#define	POLY_USE_SSE	0
+#endif
+
+#define	POLY_MAGIC_MARKER	MAKE_MAGIC (' ', 'p', 'o', 'l', 'y', ' ')
+
+/* Limits on the size of the coefficient table, beyond which the sinc converter is used instead. */
+#define	POLY_MAX_PHASES		1024
+#define	POLY_MAX_STEP		8192
+#define	POLY_MAX_COEFFS		(1 << 20)
+
+/* Taps per phase are padded to a multiple of this (and rows aligned to it) for the vector loop. */
+#define	POLY_TAP_ALIGN		4
+
+typedef struct
+{	int		poly_magic_marker ;
+
+	int		channels ;
+
+	/* Ratio the table was built for and whether the stream has started since the last reset. */
+	double	table_ratio ;
+	int		running, use_fallback ;
+
+	/* Output step is phase_step / phase_count input samples. */
+	int		phase_count, phase_step ;
+	int		half_taps, taps ;
+
+	float	*coeff_mem, *coeffs ;
+
+	/* Planar history, one row of hist_cap floats per channel. */
+	float	*hist ;
+	long	hist_cap, hist_len ;
+
+	/* First tap and phase of the next output sample, and end of real input (-1 until known). */
+	long	first ;
+	int		phase ;
+	long	real_end ;
+
+	/* Generic converter for ratios the table cannot represent. */
+	SRC_PRIVATE	fallback ;
+} POLY_FILTER ;
+
+static int poly_const_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
+static int poly_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
+static void poly_reset (SRC_PRIVATE *psrc) ;
+static void poly_close (SRC_PRIVATE *psrc) ;
+
+/*----------------------------------------------------------------------------------------
+*/
+
+const char*
+poly_get_name (int src_enum)
+{
+	if (src_enum == SRC_SINC_POLYPHASE)
+		return "Polyphase Sinc Interpolator" ;
+
+	return NULL ;
+} /* poly_get_name */
+
+const char*
+poly_get_description (int src_enum)
+{
+	if (src_enum == SRC_SINC_POLYPHASE)
+		return "Band limited sinc interpolation, medium quality, precomputed for fixed rational ratios." ;
+
+	return NULL ;
+} /* poly_get_description */
+
+int
+poly_set_converter (SRC_PRIVATE *psrc, int src_enum)
+{	POLY_FILTER *filter ;
+	int error ;
+
+	if (src_enum != SRC_SINC_POLYPHASE)
+		return SRC_ERR_BAD_CONVERTER ;
+
+	if (psrc->private_data != NULL)
+	{	if (psrc->close != NULL)
+			psrc->close (psrc) ;
+		free (psrc->private_data) ;
+		psrc->private_data = NULL ;
+		} ;
+
+	if ((filter = calloc (1, sizeof (POLY_FILTER))) == NULL)
+		return SRC_ERR_MALLOC_FAILED ;
+
+	filter->poly_magic_marker = POLY_MAGIC_MARKER ;
+	filter->channels = psrc->channels ;
+
+	filter->fallback.channels = psrc->channels ;
+	filter->fallback.mode = SRC_MODE_PROCESS ;
+	if ((error = sinc_set_converter (&filter->fallback, SRC_SINC_MEDIUM_QUALITY)) != SRC_ERR_NO_ERROR)
+	{	free (filter->fallback.private_data) ;
+		free (filter) ;
+		return error ;
+		} ;
+
+	psrc->private_data = filter ;
+	psrc->const_process = poly_const_process ;
+	psrc->vari_process = poly_vari_process ;
+	psrc->reset = poly_reset ;
+	psrc->close = poly_close ;
+
+	poly_reset (psrc) ;
+
+	return SRC_ERR_NO_ERROR ;
+} /* poly_set_converter */
+
+static void
+poly_close (SRC_PRIVATE *psrc)
+{	POLY_FILTER *filter ;
+
+	filter = (POLY_FILTER*) psrc->private_data ;
+	if (filter == NULL)
+		return ;
+
+	free (filter->coeff_mem) ;
+	free (filter->hist) ;
+	free (filter->fallback.private_data) ;
+
+	filter->coeff_mem = filter->coeffs = filter->hist = NULL ;
+	filter->fallback.private_data = NULL ;
+} /* poly_close */
+
+static void
+poly_reset (SRC_PRIVATE *psrc)
+{	POLY_FILTER *filter ;
+
+	filter = (POLY_FILTER*) psrc->private_data ;
+	if (filter == NULL)
+		return ;
+
+	filter->running = filter->use_fallback = SRC_FALSE ;
+
+	/* Start with half a filter of silence before the first input sample, as the sinc converter does. */
+	filter->first = 0 ;
+	filter->phase = 0 ;
+	filter->real_end = -1 ;
+	filter->hist_len = MAX (filter->half_taps - 1, 0) ;
+	if (filter->hist != NULL && filter->hist_len <= filter->hist_cap)
+	{	int ch ;
+
+		for (ch = 0 ; ch < filter->channels ; ch++)
+			memset (filter->hist + ch * filter->hist_cap, 0, filter->hist_len * sizeof (filter->hist [0])) ;
+		}
+	else
+	{	/* Reallocated, and filled with the silence, on the next process call. */
+		free (filter->hist) ;
+		filter->hist = NULL ;
+		filter->hist_cap = 0 ;
+		} ;
+
+	filter->fallback.last_position = 0.0 ;
+	filter->fallback.last_ratio = 0.0 ;
+	filter->fallback.error = SRC_ERR_NO_ERROR ;
+	if (filter->fallback.reset != NULL)
+		filter->fallback.reset (&filter->fallback) ;
+} /* poly_reset */
+
+/*----------------------------------------------------------------------------------------
+*/
+
+static int
+poly_find_fraction (double src_ratio, int *phase_count, int *phase_step)
+{	int step, count ;
+
+	/* Smallest step first, so the fraction found is already in lowest terms. */
+	for (step = 1 ; step <= POLY_MAX_STEP ; step++)
+	{	count = (int) lrint (src_ratio * step) ;
+		if (count < 1 || count > POLY_MAX_PHASES)
+			continue ;
+
+		if (fabs (src_ratio * step - count) < 1e-9)
+		{	*phase_count = count ;
+			*phase_step = step ;
+			return SRC_TRUE ;
+			} ;
+		} ;
+
+	return SRC_FALSE ;
+} /* poly_find_fraction */
+
+static int
+poly_build_table (POLY_FILTER *filter, double src_ratio)
+{	const float *proto ;
+	double	scale, float_increment, frac, dist, fraction ;
+	int		proto_half_len, proto_inc, phase_count, phase_step, half_taps, taps, p, k, indx ;
+	float	*mem, *row ;
+
+	if (poly_find_fraction (src_ratio, &phase_count, &phase_step) == SRC_FALSE)
+		return SRC_ERR_BAD_SRC_RATIO ;
+
+	sinc_get_coeffs (SRC_SINC_MEDIUM_QUALITY, &proto, &proto_half_len, &proto_inc) ;
+
+	/* Same filter stretch and gain as the sinc converter uses for this ratio. */
+	scale = MIN (src_ratio, 1.0) ;
+	float_increment = proto_inc * scale ;
+
+	half_taps = (int) ceil (proto_half_len / float_increment) + 1 ;
+	taps = (2 * half_taps + POLY_TAP_ALIGN - 1) & ~(POLY_TAP_ALIGN - 1) ;
+
+	if ((long) phase_count * taps > POLY_MAX_COEFFS)
+		return SRC_ERR_FILTER_LEN ;
+
+	if ((mem = malloc ((phase_count * taps + POLY_TAP_ALIGN) * sizeof (float))) == NULL)
+		return SRC_ERR_MALLOC_FAILED ;
+
+	free (filter->coeff_mem) ;
+	filter->coeff_mem = mem ;
+	filter->coeffs = (float*) (((size_t) mem + POLY_TAP_ALIGN * sizeof (float) - 1) & ~(POLY_TAP_ALIGN * sizeof (float) - 1)) ;
+
+	/*
+	** Tap k of phase p multiplies input sample (i - half_taps + 1 + k) for an output
+	** at input position i + p / phase_count. Its coefficient is the prototype
+	** interpolated at that distance, exactly as calc_output_*() does per sample.
+	*/
+	for (p = 0 ; p < phase_count ; p++)
+	{	row = filter->coeffs + p * taps ;
+		frac = (double) p / phase_count ;
+
+		for (k = 0 ; k < taps ; k++)
+		{	dist = fabs (frac + half_taps - 1 - k) * float_increment ;
+			if (dist >= proto_half_len)
+			{	row [k] = 0.0f ;
+				continue ;
+				} ;
+
+			indx = (int) dist ;
+			fraction = dist - indx ;
+			row [k] = (float) (scale * (proto [indx] + fraction * (proto [indx + 1] - proto [indx]))) ;
+			} ;
+		} ;
+
+	filter->table_ratio = src_ratio ;
+	filter->phase_count = phase_count ;
+	filter->phase_step = phase_step ;
+	filter->half_taps = half_taps ;
+	filter->taps = taps ;
+
+	return SRC_ERR_NO_ERROR ;
+} /* poly_build_table */
+
+/* Makes room for at least frames more history per channel, dropping consumed samples. */
+static int
+poly_reserve (POLY_FILTER *filter, long frames)
+{	long	keep, cap ;
+	float	*hist ;
+	int		ch ;
+
+	keep = filter->hist_len - filter->first ;
+
+	if (filter->hist != NULL && keep + frames <= filter->hist_cap)
+	{	if (filter->first > 0)
+		{	for (ch = 0 ; ch < filter->channels ; ch++)
+				memmove (filter->hist + ch * filter->hist_cap,
+						filter->hist + ch * filter->hist_cap + filter->first, keep * sizeof (filter->hist [0])) ;
+			} ;
+		}
+	else
+	{	cap = MAX (2 * (keep + frames), 4096) ;
+		if ((hist = malloc (filter->channels * cap * sizeof (filter->hist [0]))) == NULL)
+			return SRC_ERR_MALLOC_FAILED ;
+
+		if (filter->hist != NULL)
+		{	for (ch = 0 ; ch < filter->channels ; ch++)
+				memcpy (hist + ch * cap, filter->hist + ch * filter->hist_cap + filter->first, keep * sizeof (hist [0])) ;
+			}
+		else
+		{	/* First use; the reset silence has not been written anywhere yet. */
+			for (ch = 0 ; ch < filter->channels ; ch++)
+				memset (hist + ch * cap, 0, keep * sizeof (hist [0])) ;
+			} ;
+
+		free (filter->hist) ;
+		filter->hist = hist ;
+		filter->hist_cap = cap ;
+		} ;
+
+	if (filter->real_end >= 0)
+		filter->real_end -= filter->first ;
+	filter->hist_len = keep ;
+	filter->first = 0 ;
+
+	return SRC_ERR_NO_ERROR ;
+} /* poly_reserve */
+
+static inline float
+poly_dot (const float *coeffs, const float *data, int taps)
+{
+#if POLY_USE_SSE
+	__m128	sum0, sum1 ;
+	float	total [4] ;
+	int		k ;
+
+	sum0 = sum1 = _mm_setzero_ps () ;
+
+	/* The coefficient rows are aligned, the history is not. */
+	for (k = 0 ; k + 8 <= taps ; k += 8)
+	{	sum0 = _mm_add_ps (sum0, _mm_mul_ps (_mm_load_ps (coeffs + k), _mm_loadu_ps (data + k))) ;
+		sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_load_ps (coeffs + k + 4), _mm_loadu_ps (data + k + 4))) ;
+		} ;
+	if (k < taps)
+		sum0 = _mm_add_ps (sum0, _mm_mul_ps (_mm_load_ps (coeffs + k), _mm_loadu_ps (data + k))) ;
+
+	_mm_storeu_ps (total, _mm_add_ps (sum0, sum1)) ;
+
+	return (total [0] + total [2]) + (total [1] + total [3]) ;
+#else
+	float	sum [4] = { 0.0f, 0.0f, 0.0f, 0.0f } ;
+	int		k ;
+
+	for (k = 0 ; k < taps ; k += 4)
+	{	sum [0] += coeffs [k] * data [k] ;
+		sum [1] += coeffs [k + 1] * data [k + 1] ;
+		sum [2] += coeffs [k + 2] * data [k + 2] ;
+		sum [3] += coeffs [k + 3] * data [k + 3] ;
+		} ;
+
+	return (sum [0] + sum [2]) + (sum [1] + sum [3]) ;
+#endif
+} /* poly_dot */
+
+static int
+poly_fallback_process (SRC_PRIVATE *psrc, SRC_DATA *data)
+{	POLY_FILTER	*filter ;
+	SRC_PRIVATE	*sinc ;
+	int			error ;
+
+	filter = (POLY_FILTER*) psrc->private_data ;
+	sinc = &filter->fallback ;
+
+	/* Switching mid stream restarts the filter history, so only happens once per reset. */
+	filter->use_fallback = SRC_TRUE ;
+	filter->running = SRC_TRUE ;
+
+	sinc->last_ratio = psrc->last_ratio ;
+	sinc->last_position = psrc->last_position ;
+
+	if (fabs (sinc->last_ratio - data->src_ratio) < 1e-15)
+		error = sinc->const_process (sinc, data) ;
+	else
+		error = sinc->vari_process (sinc, data) ;
+
+	psrc->last_ratio = sinc->last_ratio ;
+	psrc->last_position = sinc->last_position ;
+
+	return error ;
+} /* poly_fallback_process */
+
+static int
+poly_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
+{
+	if (psrc->private_data == NULL)
+		return SRC_ERR_NO_PRIVATE ;
+
+	return poly_fallback_process (psrc, data) ;
+} /* poly_vari_process */
+
+static int
+poly_const_process (SRC_PRIVATE *psrc, SRC_DATA *data)
+{	POLY_FILTER *filter ;
+	const float	*in ;
+	float		*out, *hist ;
+	double		end_scale, end_distance ;
+	long		in_frames, out_frames, out_gen, k ;
+	int			ch, channels, error ;
+
+	if (psrc->private_data == NULL)
+		return SRC_ERR_NO_PRIVATE ;
+
+	filter = (POLY_FILTER*) psrc->private_data ;
+
+	if (filter->use_fallback)
+		return poly_fallback_process (psrc, data) ;
+
+	if (filter->table_ratio != data->src_ratio)
+	{	/* A table can only be (re)built before any output has been produced with another one. */
+		if (filter->running || poly_build_table (filter, data->src_ratio) != SRC_ERR_NO_ERROR)
+			return poly_fallback_process (psrc, data) ;
+
+		poly_reset (psrc) ;
+		} ;
+
+	filter->running = SRC_TRUE ;
+	channels = filter->channels ;
+
+	/* Take all of the input, so callers never have to resubmit any of it. */
+	in = data->data_in ;
+	in_frames = filter->real_end < 0 ? data->input_frames : 0 ;
+
+	if ((error = poly_reserve (filter, in_frames + filter->taps)) != SRC_ERR_NO_ERROR)
+		return error ;
+
+	for (ch = 0 ; ch < channels ; ch++)
+	{	hist = filter->hist + ch * filter->hist_cap + filter->hist_len ;
+		for (k = 0 ; k < in_frames ; k++)
+			hist [k] = in [k * channels + ch] ;
+		} ;
+	filter->hist_len += in_frames ;
+
+	if (data->end_of_input && filter->real_end < 0)
+	{	/* Pad with enough silence to run the filter past the last real sample. */
+		filter->real_end = filter->hist_len ;
+		for (ch = 0 ; ch < channels ; ch++)
+			memset (filter->hist + ch * filter->hist_cap + filter->hist_len, 0, filter->taps * sizeof (filter->hist [0])) ;
+		filter->hist_len += filter->taps ;
+		} ;
+
+	out = data->data_out ;
+	out_frames = data->output_frames ;
+	out_gen = 0 ;
+
+	/*
+	** Termination matches the sinc converter, which stops one output step short of the
+	** end and, with more than one channel, measures only the whole part of the position
+	** in samples rather than frames (so that it produces the same number of frames).
+	*/
+	end_scale = (double) filter->phase_count * (channels > 1 ? channels : 1) ;
+
+	while (out_gen < out_frames && filter->first + filter->taps <= filter->hist_len)
+	{	const float *coeffs = filter->coeffs + filter->phase * filter->taps ;
+
+		if (filter->real_end >= 0)
+		{	end_distance = (filter->real_end - (filter->first + filter->half_taps - 1)) * end_scale ;
+			if (channels > 1 ? filter->phase + filter->phase_step >= end_distance : filter->phase + filter->phase_step > end_distance)
+				break ;
+			} ;
+
+		hist = filter->hist + filter->first ;
+		for (ch = 0 ; ch < channels ; ch++)
+			out [out_gen * channels + ch] = poly_dot (coeffs, hist + ch * filter->hist_cap, filter->taps) ;
+		out_gen ++ ;
+
+		filter->phase += filter->phase_step ;
+		filter->first += filter->phase / filter->phase_count ;
+		filter->phase %= filter->phase_count ;
+		} ;
+
+	data->input_frames_used = in_frames ;
+	data->output_frames_gen = out_gen ;
+
+	return SRC_ERR_NO_ERROR ;
+} /* poly_const_process */
@@ -14,6 +14,27 @@
 #include "float_cast.h"
 #include "common.h"
 
+#if defined (_M_IX86) || defined (_M_X64) || defined (__i386__) || defined (__x86_64__)
+#define	SINC_X86_SIMD	1
+#if defined (_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#else
+#define	SINC_X86_SIMD	0
+#endif
+
+/* GCC and Clang need to be told which functions may use instructions beyond their default target. */
+#if SINC_X86_SIMD && (defined (__GNUC__) || defined (__clang__))
+#define	TARGET_SSE2		__attribute__ ((target ("sse2")))
+#define	TARGET_AVX2		__attribute__ ((target ("avx2")))
+#else
+#define	TARGET_SSE2
+#define	TARGET_AVX2
+#endif
+
 #define	SINC_MAGIC_MARKER	MAKE_MAGIC (' ', 's', 'i', 'n', 'c', ' ')
 
 /*========================================================================================
@@ -35,6 +56,12 @@ typedef float	coeff_t ;
 #include "mid_qual_coeffs.h"
 #include "high_qual_coeffs.h"
 
+enum
+{	SINC_SIMD_NONE = 0,
+	SINC_SIMD_SSE2,
+	SINC_SIMD_AVX2
+} ;
+
 typedef struct
 {	int		sinc_magic_marker ;
 
@@ -50,6 +77,15 @@ typedef struct
 
 	int		b_current, b_end, b_real_end, b_len ;
 
+	/*
+	** Vector kernels, NULL when the scalar calc_output_* functions are used.
+	** The first fills in the interpolated coefficient for each tap, the
+	** second applies them to the buffered input of every channel.
+	*/
+	void	(*calc_weights) (const coeff_t *coeffs, increment_t filter_index, increment_t step, int count, void *weights, int offset) ;
+	void	(*calc_dot) (const float *data, const void *weights, int taps, int channels, double scale, float *output) ;
+	void	*weights ;
+
 	/* Sure hope noone does more than 128 channels at once. */
 	double left_calc [128], right_calc [128] ;
 
@@ -67,6 +103,9 @@ static int prepare_data (SINC_FILTER *filter, SRC_DATA *data, int half_filter_ch
 
 static void sinc_reset (SRC_PRIVATE *psrc) ;
 
+static int sinc_simd_level (void) ;
+static void sinc_set_kernels (SINC_FILTER *filter, int src_enum, int simd_level) ;
+
 static inline increment_t
 double_to_fp (double x)
 {	return (lrint ((x) * FP_ONE)) ;
@@ -139,7 +178,8 @@ int
 sinc_set_converter (SRC_PRIVATE *psrc, int src_enum)
 {	SINC_FILTER *filter, temp_filter ;
 	increment_t count ;
-	int bits ;
+	int bits, simd_level ;
+	size_t weights_size ;
 
 	/* Quick sanity check. */
 	if (SHIFT_BITS >= sizeof (increment_t) * 8 - 1)
@@ -214,12 +254,25 @@ sinc_set_converter (SRC_PRIVATE *psrc, int src_enum)
 	temp_filter.b_len = MAX (temp_filter.b_len, 4096) ;
 	temp_filter.b_len *= temp_filter.channels ;
 
-	if ((filter = calloc (1, sizeof (SINC_FILTER) + sizeof (filter->buffer [0]) * (temp_filter.b_len + temp_filter.channels))) == NULL)
+	/* The vector kernels need room for the coefficients of both halves of the filter at the lowest ratio. */
+	simd_level = sinc_simd_level () ;
+	weights_size = 0 ;
+	if (simd_level != SINC_SIMD_NONE)
+	{	weights_size = 2 * (lrint (temp_filter.coeff_half_len / (temp_filter.index_inc * 1.0) * SRC_MAX_RATIO) + 4) ;
+		weights_size = weights_size * sizeof (double) + 32 ;
+		} ;
+
+	if ((filter = calloc (1, sizeof (SINC_FILTER) + sizeof (filter->buffer [0]) * (temp_filter.b_len + temp_filter.channels) + weights_size)) == NULL)
 		return SRC_ERR_MALLOC_FAILED ;
 
 	*filter = temp_filter ;
 	memset (&temp_filter, 0xEE, sizeof (temp_filter)) ;
 
+	if (weights_size > 0)
+	{	filter->weights = (void*) (((size_t) (filter->buffer + filter->b_len + filter->channels) + 31) & ~((size_t) 31)) ;
+		sinc_set_kernels (filter, src_enum, simd_level) ;
+		} ;
+
 	psrc->private_data = filter ;
 
 	sinc_reset (psrc) ;
@@ -234,6 +287,30 @@ sinc_set_converter (SRC_PRIVATE *psrc, int src_enum)
 	return SRC_ERR_NO_ERROR ;
 } /* sinc_set_converter */
 
+void
+sinc_get_coeffs (int src_enum, const float **coeffs, int *half_len, int *increment)
+{
+	switch (src_enum)
+	{	case SRC_SINC_FASTEST :
+				*coeffs = fastest_coeffs.coeffs ;
+				*half_len = ARRAY_LEN (fastest_coeffs.coeffs) - 2 ;
+				*increment = fastest_coeffs.increment ;
+				break ;
+
+		case SRC_SINC_BEST_QUALITY :
+				*coeffs = slow_high_qual_coeffs.coeffs ;
+				*half_len = ARRAY_LEN (slow_high_qual_coeffs.coeffs) - 2 ;
+				*increment = slow_high_qual_coeffs.increment ;
+				break ;
+
+		default :
+				*coeffs = slow_mid_qual_coeffs.coeffs ;
+				*half_len = ARRAY_LEN (slow_mid_qual_coeffs.coeffs) - 2 ;
+				*increment = slow_mid_qual_coeffs.increment ;
+				break ;
+		} ;
+} /* sinc_get_coeffs */
+
 static void
 sinc_reset (SRC_PRIVATE *psrc)
 {	SINC_FILTER *filter ;
@@ -257,6 +334,29 @@ sinc_reset (SRC_PRIVATE *psrc)
 **	Beware all ye who dare pass this point. There be dragons here.
 */
 
+static inline void
+calc_output_simd (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index, double scale, float * output)
+{	increment_t	max_filter_index, right_filter_index ;
+	int			left_count, right_count ;
+
+	/*
+	** The same taps as calc_output_* () use, laid out in input order: the
+	** left half counts the filter index down to start_filter_index, the right
+	** half counts up from (increment - start_filter_index).
+	*/
+	max_filter_index = int_to_fp (filter->coeff_half_len) ;
+
+	left_count = (max_filter_index - start_filter_index) / increment ;
+	right_filter_index = increment - start_filter_index ;
+	right_count = (max_filter_index - right_filter_index) / increment ;
+
+	filter->calc_weights (filter->coeffs, start_filter_index + left_count * increment, -increment, left_count + 1, filter->weights, 0) ;
+	filter->calc_weights (filter->coeffs, right_filter_index, increment, right_count + 1, filter->weights, left_count + 1) ;
+
+	filter->calc_dot (filter->buffer + filter->b_current - filter->channels * left_count, filter->weights,
+							left_count + right_count + 2, filter->channels, scale, output) ;
+} /* calc_output_simd */
+
 static inline double
 calc_output_single (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index)
 {	double		fraction, left, right, icoeff ;
@@ -380,8 +480,11 @@ sinc_mono_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 
 		start_filter_index = double_to_fp (input_index * float_increment) ;
 
-		data->data_out [filter->out_gen] = (float) ((float_increment / filter->index_inc) *
-										calc_output_single (filter, increment, start_filter_index)) ;
+		if (filter->calc_dot != NULL)
+			calc_output_simd (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		else
+			data->data_out [filter->out_gen] = (float) ((float_increment / filter->index_inc) *
+											calc_output_single (filter, increment, start_filter_index)) ;
 		filter->out_gen ++ ;
 
 		/* Figure out the next index. */
@@ -529,7 +632,10 @@ sinc_stereo_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 
 		start_filter_index = double_to_fp (input_index * float_increment) ;
 
-		calc_output_stereo (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		if (filter->calc_dot != NULL)
+			calc_output_simd (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		else
+			calc_output_stereo (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
 		filter->out_gen += 2 ;
 
 		/* Figure out the next index. */
@@ -683,7 +789,10 @@ sinc_quad_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 
 		start_filter_index = double_to_fp (input_index * float_increment) ;
 
-		calc_output_quad (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		if (filter->calc_dot != NULL)
+			calc_output_simd (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		else
+			calc_output_quad (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
 		filter->out_gen += 4 ;
 
 		/* Figure out the next index. */
@@ -843,7 +952,10 @@ sinc_hex_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 
 		start_filter_index = double_to_fp (input_index * float_increment) ;
 
-		calc_output_hex (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		if (filter->calc_dot != NULL)
+			calc_output_simd (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		else
+			calc_output_hex (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
 		filter->out_gen += 6 ;
 
 		/* Figure out the next index. */
@@ -1090,7 +1202,10 @@ sinc_multichan_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 
 		start_filter_index = double_to_fp (input_index * float_increment) ;
 
-		calc_output_multi (filter, increment, start_filter_index, filter->channels, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		if (filter->calc_dot != NULL)
+			calc_output_simd (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		else
+			calc_output_multi (filter, increment, start_filter_index, filter->channels, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
 		filter->out_gen += psrc->channels ;
 
 		/* Figure out the next index. */
@@ -1188,4 +1303,489 @@ prepare_data (SINC_FILTER *filter, SRC_DATA *data, int half_filter_chan_len)
 	return 0 ;
 } /* prepare_data */
 
+/*========================================================================================
+**	Vector kernels.
+**
+**	SRC_SINC_FASTEST and SRC_SINC_MEDIUM_QUALITY interpolate the coefficients
+**	and accumulate in single precision. SRC_SINC_BEST_QUALITY keeps both in
+**	double precision, since single precision rounding noise would be close to
+**	its 144dB SNR. Setting the environment variable LIBSAMPLERATE_SIMD to
+**	"none" or "sse2" before creating a converter limits which are used.
+*/
+
+static int
+sinc_detect_simd (void)
+{	int level = SINC_SIMD_NONE ;
+
+#if SINC_X86_SIMD
+	unsigned int max_leaf, ecx1, edx1, ebx7, xcr0 ;
+
+#if defined (_MSC_VER)
+	int info [4] ;
+
+	__cpuid (info, 0) ;
+	max_leaf = info [0] ;
+	__cpuid (info, 1) ;
+	ecx1 = info [2] ;
+	edx1 = info [3] ;
+	ebx7 = 0 ;
+	if (max_leaf >= 7)
+	{	__cpuidex (info, 7, 0) ;
+		ebx7 = info [1] ;
+		} ;
+#else
+	unsigned int eax, ebx, ecx, edx ;
+
+	max_leaf = __get_cpuid_max (0, NULL) ;
+	ecx1 = edx1 = ebx7 = 0 ;
+	if (__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+	{	ecx1 = ecx ;
+		edx1 = edx ;
+		} ;
+	if (max_leaf >= 7)
+	{	__cpuid_count (7, 0, eax, ebx, ecx, edx) ;
+		ebx7 = ebx ;
+		} ;
+#endif
+
+	if (edx1 & (1u << 26))
+		level = SINC_SIMD_SSE2 ;
+
+	/* AVX2 also needs the OS to save the upper halves of the YMM registers. */
+	if (level == SINC_SIMD_SSE2 && (ebx7 & (1u << 5)) && (ecx1 & (1u << 27)) && (ecx1 & (1u << 28)))
+	{
+#if defined (_MSC_VER)
+		xcr0 = (unsigned int) _xgetbv (0) ;
+#else
+		__asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0)) ;
+#endif
+		if ((xcr0 & 6) == 6)
+			level = SINC_SIMD_AVX2 ;
+		} ;
+#endif
+
+	return level ;
+} /* sinc_detect_simd */
+
+static int
+sinc_simd_level (void)
+{	static int cpu_level = -1 ;
+	const char *limit ;
+	int level ;
+
+	/* Every thread detects the same thing, so a racing first call is harmless. */
+	if (cpu_level < 0)
+		cpu_level = sinc_detect_simd () ;
+	level = cpu_level ;
+
+	if ((limit = getenv ("LIBSAMPLERATE_SIMD")) != NULL)
+	{	if (strcmp (limit, "none") == 0)
+			level = SINC_SIMD_NONE ;
+		else if (strcmp (limit, "sse2") == 0)
+			level = MIN (level, SINC_SIMD_SSE2) ;
+		} ;
+
+	return level ;
+} /* sinc_simd_level */
+
+#if SINC_X86_SIMD
+
+#define	FP_FRACTION_MASK	((((increment_t) 1) << SHIFT_BITS) - 1)
+
+/*
+** Interpolated coefficients for count taps, starting at filter_index and
+** stepping by step, written to weights [offset] onwards.
+*/
+
+static TARGET_SSE2 void
+weights_float_sse2 (const coeff_t *coeffs, increment_t filter_index, increment_t step, int count, void *weights, int offset)
+{	float	*w = (float*) weights + offset ;
+	__m128i	index, index_step, mask ;
+	__m128	fraction, c0, c1, scale ;
+	int		k, indx [4] ;
+
+	index = _mm_setr_epi32 (filter_index, filter_index + step, filter_index + 2 * step, filter_index + 3 * step) ;
+	index_step = _mm_set1_epi32 (4 * step) ;
+	mask = _mm_set1_epi32 (FP_FRACTION_MASK) ;
+	scale = _mm_set1_ps ((float) INV_FP_ONE) ;
+
+	for (k = 0 ; k + 4 <= count ; k += 4)
+	{	indx [0] = fp_to_int (filter_index) ;
+		indx [1] = fp_to_int (filter_index + step) ;
+		indx [2] = fp_to_int (filter_index + 2 * step) ;
+		indx [3] = fp_to_int (filter_index + 3 * step) ;
+
+		c0 = _mm_setr_ps (coeffs [indx [0]], coeffs [indx [1]], coeffs [indx [2]], coeffs [indx [3]]) ;
+		c1 = _mm_setr_ps (coeffs [indx [0] + 1], coeffs [indx [1] + 1], coeffs [indx [2] + 1], coeffs [indx [3] + 1]) ;
+		fraction = _mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (index, mask)), scale) ;
+
+		_mm_storeu_ps (w + k, _mm_add_ps (c0, _mm_mul_ps (fraction, _mm_sub_ps (c1, c0)))) ;
+
+		index = _mm_add_epi32 (index, index_step) ;
+		filter_index += 4 * step ;
+		} ;
+
+	for ( ; k < count ; k++)
+	{	indx [0] = fp_to_int (filter_index) ;
+		w [k] = coeffs [indx [0]] + (float) fp_to_double (filter_index) * (coeffs [indx [0] + 1] - coeffs [indx [0]]) ;
+		filter_index += step ;
+		} ;
+} /* weights_float_sse2 */
+
+static TARGET_AVX2 void
+weights_float_avx2 (const coeff_t *coeffs, increment_t filter_index, increment_t step, int count, void *weights, int offset)
+{	float	*w = (float*) weights + offset ;
+	__m256i	index, index_step, mask, indx ;
+	__m256	fraction, c0, c1, scale ;
+	int		k, i ;
+
+	index = _mm256_add_epi32 (_mm256_set1_epi32 (filter_index),
+					_mm256_mullo_epi32 (_mm256_set1_epi32 (step), _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7))) ;
+	index_step = _mm256_set1_epi32 (8 * step) ;
+	mask = _mm256_set1_epi32 (FP_FRACTION_MASK) ;
+	scale = _mm256_set1_ps ((float) INV_FP_ONE) ;
+
+	for (k = 0 ; k + 8 <= count ; k += 8)
+	{	indx = _mm256_srai_epi32 (index, SHIFT_BITS) ;
 
+		c0 = _mm256_i32gather_ps (coeffs, indx, 4) ;
+		c1 = _mm256_i32gather_ps (coeffs + 1, indx, 4) ;
+		fraction = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_and_si256 (index, mask)), scale) ;
+
+		_mm256_storeu_ps (w + k, _mm256_add_ps (c0, _mm256_mul_ps (fraction, _mm256_sub_ps (c1, c0)))) ;
+
+		index = _mm256_add_epi32 (index, index_step) ;
+		filter_index += 8 * step ;
+		} ;
+
+	for ( ; k < count ; k++)
+	{	i = fp_to_int (filter_index) ;
+		w [k] = coeffs [i] + (float) fp_to_double (filter_index) * (coeffs [i + 1] - coeffs [i]) ;
+		filter_index += step ;
+		} ;
+} /* weights_float_avx2 */
+
+/* The double precision versions match the scalar code's interpolation exactly. */
+
+static TARGET_SSE2 void
+weights_double_sse2 (const coeff_t *coeffs, increment_t filter_index, increment_t step, int count, void *weights, int offset)
+{	double	*w = (double*) weights + offset ;
+	__m128i	index, index_step, mask, frac_bits ;
+	__m128	c0, delta ;
+	__m128d	scale ;
+	int		k, indx [4] ;
+
+	index = _mm_setr_epi32 (filter_index, filter_index + step, filter_index + 2 * step, filter_index + 3 * step) ;
+	index_step = _mm_set1_epi32 (4 * step) ;
+	mask = _mm_set1_epi32 (FP_FRACTION_MASK) ;
+	scale = _mm_set1_pd (INV_FP_ONE) ;
+
+	for (k = 0 ; k + 4 <= count ; k += 4)
+	{	indx [0] = fp_to_int (filter_index) ;
+		indx [1] = fp_to_int (filter_index + step) ;
+		indx [2] = fp_to_int (filter_index + 2 * step) ;
+		indx [3] = fp_to_int (filter_index + 3 * step) ;
+
+		c0 = _mm_setr_ps (coeffs [indx [0]], coeffs [indx [1]], coeffs [indx [2]], coeffs [indx [3]]) ;
+		delta = _mm_sub_ps (_mm_setr_ps (coeffs [indx [0] + 1], coeffs [indx [1] + 1], coeffs [indx [2] + 1], coeffs [indx [3] + 1]), c0) ;
+		frac_bits = _mm_and_si128 (index, mask) ;
+
+		_mm_storeu_pd (w + k, _mm_add_pd (_mm_cvtps_pd (c0),
+						_mm_mul_pd (_mm_mul_pd (_mm_cvtepi32_pd (frac_bits), scale), _mm_cvtps_pd (delta)))) ;
+		_mm_storeu_pd (w + k + 2, _mm_add_pd (_mm_cvtps_pd (_mm_movehl_ps (c0, c0)),
+						_mm_mul_pd (_mm_mul_pd (_mm_cvtepi32_pd (_mm_unpackhi_epi64 (frac_bits, frac_bits)), scale),
+							_mm_cvtps_pd (_mm_movehl_ps (delta, delta))))) ;
+
+		index = _mm_add_epi32 (index, index_step) ;
+		filter_index += 4 * step ;
+		} ;
+
+	for ( ; k < count ; k++)
+	{	indx [0] = fp_to_int (filter_index) ;
+		w [k] = coeffs [indx [0]] + fp_to_double (filter_index) * (coeffs [indx [0] + 1] - coeffs [indx [0]]) ;
+		filter_index += step ;
+		} ;
+} /* weights_double_sse2 */
+
+static TARGET_AVX2 void
+weights_double_avx2 (const coeff_t *coeffs, increment_t filter_index, increment_t step, int count, void *weights, int offset)
+{	double	*w = (double*) weights + offset ;
+	__m256i	index, index_step, mask, indx, frac_bits ;
+	__m256	c0, delta ;
+	__m256d	scale ;
+	int		k, i ;
+
+	index = _mm256_add_epi32 (_mm256_set1_epi32 (filter_index),
+					_mm256_mullo_epi32 (_mm256_set1_epi32 (step), _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7))) ;
+	index_step = _mm256_set1_epi32 (8 * step) ;
+	mask = _mm256_set1_epi32 (FP_FRACTION_MASK) ;
+	scale = _mm256_set1_pd (INV_FP_ONE) ;
+
+	for (k = 0 ; k + 8 <= count ; k += 8)
+	{	indx = _mm256_srai_epi32 (index, SHIFT_BITS) ;
+
+		c0 = _mm256_i32gather_ps (coeffs, indx, 4) ;
+		delta = _mm256_sub_ps (_mm256_i32gather_ps (coeffs + 1, indx, 4), c0) ;
+		frac_bits = _mm256_and_si256 (index, mask) ;
+
+		_mm256_storeu_pd (w + k, _mm256_add_pd (_mm256_cvtps_pd (_mm256_castps256_ps128 (c0)),
+						_mm256_mul_pd (_mm256_mul_pd (_mm256_cvtepi32_pd (_mm256_castsi256_si128 (frac_bits)), scale),
+							_mm256_cvtps_pd (_mm256_castps256_ps128 (delta))))) ;
+		_mm256_storeu_pd (w + k + 4, _mm256_add_pd (_mm256_cvtps_pd (_mm256_extractf128_ps (c0, 1)),
+						_mm256_mul_pd (_mm256_mul_pd (_mm256_cvtepi32_pd (_mm256_extracti128_si256 (frac_bits, 1)), scale),
+							_mm256_cvtps_pd (_mm256_extractf128_ps (delta, 1))))) ;
+
+		index = _mm256_add_epi32 (index, index_step) ;
+		filter_index += 8 * step ;
+		} ;
+
+	for ( ; k < count ; k++)
+	{	i = fp_to_int (filter_index) ;
+		w [k] = coeffs [i] + fp_to_double (filter_index) * (coeffs [i + 1] - coeffs [i]) ;
+		filter_index += step ;
+		} ;
+} /* weights_double_avx2 */
+
+/*
+** Dot products of taps weights with the input, data [0] being the first
+** channel of the first tap. Taps are channels floats apart.
+*/
+
+static TARGET_SSE2 void
+dot_float_mono_sse2 (const float *data, const void *weights, int taps, int channels, double scale, float *output)
+{	const float	*w = (const float*) weights ;
+	__m128		sum0, sum1 ;
+	float		total [4], tail = 0.0f ;
+	int			k ;
+
+	(void) channels ;
+
+	sum0 = sum1 = _mm_setzero_ps () ;
+	for (k = 0 ; k + 8 <= taps ; k += 8)
+	{	sum0 = _mm_add_ps (sum0, _mm_mul_ps (_mm_loadu_ps (w + k), _mm_loadu_ps (data + k))) ;
+		sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_loadu_ps (w + k + 4), _mm_loadu_ps (data + k + 4))) ;
+		} ;
+	for ( ; k < taps ; k++)
+		tail += w [k] * data [k] ;
+
+	_mm_storeu_ps (total, _mm_add_ps (sum0, sum1)) ;
+
+	output [0] = (float) (scale * ((total [0] + total [2]) + (total [1] + total [3]) + tail)) ;
+} /* dot_float_mono_sse2 */
+
+static TARGET_SSE2 void
+dot_float_stereo_sse2 (const float *data, const void *weights, int taps, int channels, double scale, float *output)
+{	const float	*w = (const float*) weights ;
+	__m128		sum0, sum1, wv ;
+	float		total [4], tail [2] = { 0.0f, 0.0f } ;
+	int			k ;
+
+	(void) channels ;
+
+	/* Each weight is duplicated across the left and right samples of its frame. */
+	sum0 = sum1 = _mm_setzero_ps () ;
+	for (k = 0 ; k + 4 <= taps ; k += 4)
+	{	wv = _mm_loadu_ps (w + k) ;
+		sum0 = _mm_add_ps (sum0, _mm_mul_ps (_mm_unpacklo_ps (wv, wv), _mm_loadu_ps (data + 2 * k))) ;
+		sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_unpackhi_ps (wv, wv), _mm_loadu_ps (data + 2 * k + 4))) ;
+		} ;
+	for ( ; k < taps ; k++)
+	{	tail [0] += w [k] * data [2 * k] ;
+		tail [1] += w [k] * data [2 * k + 1] ;
+		} ;
+
+	_mm_storeu_ps (total, _mm_add_ps (sum0, sum1)) ;
+
+	output [0] = (float) (scale * (total [0] + total [2] + tail [0])) ;
+	output [1] = (float) (scale * (total [1] + total [3] + tail [1])) ;
+} /* dot_float_stereo_sse2 */
+
+static TARGET_SSE2 void
+dot_float_multi_sse2 (const float *data, const void *weights, int taps, int channels, double scale, float *output)
+{	const float	*w = (const float*) weights ;
+	const float	*ptr ;
+	__m128		sum, odd ;
+	float		total [4] ;
+	int			k, ch ;
+
+	/* Four channels at a time, then a pair, then a single one. */
+	for (ch = 0 ; ch + 4 <= channels ; ch += 4)
+	{	sum = odd = _mm_setzero_ps () ;
+		for (k = 0, ptr = data + ch ; k + 2 <= taps ; k += 2, ptr += 2 * channels)
+		{	sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (w [k]), _mm_loadu_ps (ptr))) ;
+			odd = _mm_add_ps (odd, _mm_mul_ps (_mm_set1_ps (w [k + 1]), _mm_loadu_ps (ptr + channels))) ;
+			} ;
+		if (k < taps)
+			sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (w [k]), _mm_loadu_ps (ptr))) ;
+
+		_mm_storeu_ps (total, _mm_add_ps (sum, odd)) ;
+		output [ch] = (float) (scale * total [0]) ;
+		output [ch + 1] = (float) (scale * total [1]) ;
+		output [ch + 2] = (float) (scale * total [2]) ;
+		output [ch + 3] = (float) (scale * total [3]) ;
+		} ;
+
+	if (ch + 2 <= channels)
+	{	sum = _mm_setzero_ps () ;
+		for (k = 0, ptr = data + ch ; k < taps ; k++, ptr += channels)
+			sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (w [k]), _mm_loadl_pi (_mm_setzero_ps (), (const __m64*) ptr))) ;
+
+		_mm_storeu_ps (total, sum) ;
+		output [ch] = (float) (scale * total [0]) ;
+		output [ch + 1] = (float) (scale * total [1]) ;
+		ch += 2 ;
+		} ;
+
+	if (ch < channels)
+	{	total [0] = 0.0f ;
+		for (k = 0, ptr = data + ch ; k < taps ; k++, ptr += channels)
+			total [0] += w [k] * ptr [0] ;
+
+		output [ch] = (float) (scale * total [0]) ;
+		} ;
+} /* dot_float_multi_sse2 */
+
+static TARGET_SSE2 void
+dot_double_mono_sse2 (const float *data, const void *weights, int taps, int channels, double scale, float *output)
+{	const double	*w = (const double*) weights ;
+	__m128d			sum0, sum1 ;
+	__m128			x ;
+	double			total [2], tail = 0.0 ;
+	int				k ;
+
+	(void) channels ;
+
+	sum0 = sum1 = _mm_setzero_pd () ;
+	for (k = 0 ; k + 4 <= taps ; k += 4)
+	{	x = _mm_loadu_ps (data + k) ;
+		sum0 = _mm_add_pd (sum0, _mm_mul_pd (_mm_loadu_pd (w + k), _mm_cvtps_pd (x))) ;
+		sum1 = _mm_add_pd (sum1, _mm_mul_pd (_mm_loadu_pd (w + k + 2), _mm_cvtps_pd (_mm_movehl_ps (x, x)))) ;
+		} ;
+	for ( ; k < taps ; k++)
+		tail += w [k] * data [k] ;
+
+	_mm_storeu_pd (total, _mm_add_pd (sum0, sum1)) ;
+
+	output [0] = (float) (scale * (total [0] + total [1] + tail)) ;
+} /* dot_double_mono_sse2 */
+
+static TARGET_SSE2 void
+dot_double_stereo_sse2 (const float *data, const void *weights, int taps, int channels, double scale, float *output)
+{	const double	*w = (const double*) weights ;
+	__m128d			sum0, sum1, wv ;
+	__m128			x ;
+	double			total [2] ;
+	int				k ;
+
+	(void) channels ;
+
+	sum0 = sum1 = _mm_setzero_pd () ;
+	for (k = 0 ; k + 2 <= taps ; k += 2)
+	{	x = _mm_loadu_ps (data + 2 * k) ;
+		wv = _mm_loadu_pd (w + k) ;
+		sum0 = _mm_add_pd (sum0, _mm_mul_pd (_mm_unpacklo_pd (wv, wv), _mm_cvtps_pd (x))) ;
+		sum1 = _mm_add_pd (sum1, _mm_mul_pd (_mm_unpackhi_pd (wv, wv), _mm_cvtps_pd (_mm_movehl_ps (x, x)))) ;
+		} ;
+	if (k < taps)
+		sum0 = _mm_add_pd (sum0, _mm_mul_pd (_mm_set1_pd (w [k]),
+						_mm_cvtps_pd (_mm_loadl_pi (_mm_setzero_ps (), (const __m64*) (data + 2 * k))))) ;
+
+	_mm_storeu_pd (total, _mm_add_pd (sum0, sum1)) ;
+
+	output [0] = (float) (scale * total [0]) ;
+	output [1] = (float) (scale * total [1]) ;
+} /* dot_double_stereo_sse2 */
+
+static TARGET_SSE2 void
+dot_double_multi_sse2 (const float *data, const void *weights, int taps, int channels, double scale, float *output)
+{	const double	*w = (const double*) weights ;
+	const float		*ptr ;
+	__m128d			sum, sum_hi, wv ;
+	__m128			x ;
+	double			total [4] ;
+	int				k, ch ;
+
+	/* Four channels at a time, then a pair, then a single one. */
+	for (ch = 0 ; ch + 4 <= channels ; ch += 4)
+	{	sum = sum_hi = _mm_setzero_pd () ;
+		for (k = 0, ptr = data + ch ; k < taps ; k++, ptr += channels)
+		{	wv = _mm_set1_pd (w [k]) ;
+			x = _mm_loadu_ps (ptr) ;
+			sum = _mm_add_pd (sum, _mm_mul_pd (wv, _mm_cvtps_pd (x))) ;
+			sum_hi = _mm_add_pd (sum_hi, _mm_mul_pd (wv, _mm_cvtps_pd (_mm_movehl_ps (x, x)))) ;
+			} ;
+
+		_mm_storeu_pd (total, sum) ;
+		_mm_storeu_pd (total + 2, sum_hi) ;
+		output [ch] = (float) (scale * total [0]) ;
+		output [ch + 1] = (float) (scale * total [1]) ;
+		output [ch + 2] = (float) (scale * total [2]) ;
+		output [ch + 3] = (float) (scale * total [3]) ;
+		} ;
+
+	if (ch + 2 <= channels)
+	{	sum = _mm_setzero_pd () ;
+		for (k = 0, ptr = data + ch ; k < taps ; k++, ptr += channels)
+			sum = _mm_add_pd (sum, _mm_mul_pd (_mm_set1_pd (w [k]),
+						_mm_cvtps_pd (_mm_loadl_pi (_mm_setzero_ps (), (const __m64*) ptr)))) ;
+
+		_mm_storeu_pd (total, sum) ;
+		output [ch] = (float) (scale * total [0]) ;
+		output [ch + 1] = (float) (scale * total [1]) ;
+		ch += 2 ;
+		} ;
+
+	if (ch < channels)
+	{	total [0] = 0.0 ;
+		for (k = 0, ptr = data + ch ; k < taps ; k++, ptr += channels)
+			total [0] += w [k] * ptr [0] ;
+
+		output [ch] = (float) (scale * total [0]) ;
+		} ;
+} /* dot_double_multi_sse2 */
+
+#endif /* SINC_X86_SIMD */
+
+static void
+sinc_set_kernels (SINC_FILTER *filter, int src_enum, int simd_level)
+{
+	filter->calc_weights = NULL ;
+	filter->calc_dot = NULL ;
+
+#if SINC_X86_SIMD
+	if (simd_level == SINC_SIMD_NONE)
+		return ;
+
+	if (src_enum == SRC_SINC_BEST_QUALITY)
+	{	filter->calc_weights = simd_level == SINC_SIMD_AVX2 ? weights_double_avx2 : weights_double_sse2 ;
+		switch (filter->channels)
+		{	case 1 :
+				filter->calc_dot = dot_double_mono_sse2 ;
+				break ;
+			case 2 :
+				filter->calc_dot = dot_double_stereo_sse2 ;
+				break ;
+			default :
+				filter->calc_dot = dot_double_multi_sse2 ;
+				break ;
+			} ;
+		}
+	else
+	{	filter->calc_weights = simd_level == SINC_SIMD_AVX2 ? weights_float_avx2 : weights_float_sse2 ;
+		switch (filter->channels)
+		{	case 1 :
+				filter->calc_dot = dot_float_mono_sse2 ;
+				break ;
+			case 2 :
+				filter->calc_dot = dot_float_stereo_sse2 ;
+				break ;
+			default :
+				filter->calc_dot = dot_float_multi_sse2 ;
+				break ;
+			} ;
+		} ;
+#else
+	(void) src_enum ;
+	(void) simd_level ;
+#endif
+} /* sinc_set_kernels */
@@ -43,12 +43,17 @@ main (void)
 	for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
 		callback_test (SRC_SINC_FASTEST, src_ratios [k]) ;
 
+	puts ("    Polyphase sinc interpolator :") ;
+	for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
+		callback_test (SRC_SINC_POLYPHASE, src_ratios [k]) ;
+
 	puts ("") ;
 
 	puts ("    End of stream test :") ;
 	end_of_stream_test (SRC_ZERO_ORDER_HOLD) ;
 	end_of_stream_test (SRC_LINEAR) ;
 	end_of_stream_test (SRC_SINC_FASTEST) ;
+	end_of_stream_test (SRC_SINC_POLYPHASE) ;
 
 	puts ("") ;
 	return 0 ;
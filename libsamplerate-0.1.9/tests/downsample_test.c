@@ -44,6 +44,7 @@ main (void)
 	downsample_test (SRC_SINC_FASTEST) ;
 	downsample_test (SRC_SINC_MEDIUM_QUALITY) ;
 	downsample_test (SRC_SINC_BEST_QUALITY) ;
+	downsample_test (SRC_SINC_POLYPHASE) ;
 
 	puts ("") ;
 
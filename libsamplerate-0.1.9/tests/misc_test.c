@@ -26,7 +26,7 @@ main (void)
 
 	printf ("    version : %s\n\n", src_get_version ()) ;
 
-	/* Current max converter is SRC_LINEAR. */
+	/* Current max converter is SRC_SINC_POLYPHASE. */
 	name_test () ;
 
 	error_test () ;
@@ -36,6 +36,7 @@ main (void)
 	zero_input_test (SRC_ZERO_ORDER_HOLD) ;
 	zero_input_test (SRC_LINEAR) ;
 	zero_input_test (SRC_SINC_FASTEST) ;
+	zero_input_test (SRC_SINC_POLYPHASE) ;
 
 	puts ("") ;
 	return 0 ;
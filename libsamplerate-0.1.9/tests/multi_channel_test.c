@@ -64,6 +64,14 @@ main (void)
 		callback_test	(SRC_SINC_FASTEST, k, target) ;
 		} ;
 
+	puts ("\n    Polyphase sinc interpolator :") ;
+	target = 100.0 ;
+	for (k = 1 ; k <= MAX_CHANNELS ; k++)
+	{	simple_test		(SRC_SINC_POLYPHASE, k, target) ;
+		process_test	(SRC_SINC_POLYPHASE, k, target) ;
+		callback_test	(SRC_SINC_POLYPHASE, k, target) ;
+		} ;
+
 	fftw_cleanup () ;
 	puts ("") ;
 
@@ -30,10 +30,12 @@ main (void)
 	process_reset_test (SRC_ZERO_ORDER_HOLD) ;
 	process_reset_test (SRC_LINEAR) ;
 	process_reset_test (SRC_SINC_FASTEST) ;
+	process_reset_test (SRC_SINC_POLYPHASE) ;
 
 	callback_reset_test (SRC_ZERO_ORDER_HOLD) ;
 	callback_reset_test (SRC_LINEAR) ;
 	callback_reset_test (SRC_SINC_FASTEST) ;
+	callback_reset_test (SRC_SINC_POLYPHASE) ;
 
 	puts ("") ;
 
@@ -0,0 +1,138 @@
+/*
+** Copyright (c) 2002-2016, Erik de Castro Lopo <erikd@mega-nerd.com>
+** All rights reserved.
+**
+** This code is released under 2-clause BSD license. Please see the
+** file at : https://github.com/erikd/libsamplerate/blob/master/COPYING
+*/
+
+/*
+**	Checks the vector sinc kernels against the scalar ones. The scalar code
+**	is selected by setting LIBSAMPLERATE_SIMD to "none" before src_new ().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <samplerate.h>
+
+#include "util.h"
+
+#define	BUFFER_LEN		8192
+#define	MAX_CHANNELS	8
+
+static void simd_test (int converter, int channels, double src_ratio, double max_error_db) ;
+static long convert (const char *simd, int converter, int channels, double src_ratio, const float *input, float *output) ;
+
+static float input [BUFFER_LEN * MAX_CHANNELS] ;
+static float scalar_out [3 * BUFFER_LEN * MAX_CHANNELS], simd_out [3 * BUFFER_LEN * MAX_CHANNELS] ;
+
+int
+main (void)
+{	static double src_ratios [] =
+	{	0.3, 0.91875, 1.0, 1.001, 1.33, 2.7
+		} ;
+	static int channel_counts [] =
+	{	1, 2, 3, 4, 6, 8
+		} ;
+
+	int k, ch ;
+
+	puts ("") ;
+
+	/* The single precision kernels are held to about the resolution of a float. */
+	puts ("    Fastest sinc interpolator :") ;
+	for (ch = 0 ; ch < ARRAY_LEN (channel_counts) ; ch++)
+		for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
+			simd_test (SRC_SINC_FASTEST, channel_counts [ch], src_ratios [k], -115.0) ;
+
+	puts ("    Medium sinc interpolator :") ;
+	for (ch = 0 ; ch < ARRAY_LEN (channel_counts) ; ch++)
+		for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
+			simd_test (SRC_SINC_MEDIUM_QUALITY, channel_counts [ch], src_ratios [k], -115.0) ;
+
+	/* The double precision kernels only differ in the order of the sums. */
+	puts ("    Best sinc interpolator :") ;
+	for (ch = 0 ; ch < ARRAY_LEN (channel_counts) ; ch++)
+		for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
+			simd_test (SRC_SINC_BEST_QUALITY, channel_counts [ch], src_ratios [k], -138.0) ;
+
+	puts ("") ;
+
+	return 0 ;
+} /* main */
+
+static void
+simd_test (int converter, int channels, double src_ratio, double max_error_db)
+{	static const char *simd_levels [] =
+	{	"LIBSAMPLERATE_SIMD=sse2", "LIBSAMPLERATE_SIMD=all"
+		} ;
+	static float mono [BUFFER_LEN] ;
+	static float planar [BUFFER_LEN * MAX_CHANNELS] ;
+
+	double	freq, max_error, error_db ;
+	long	scalar_frames, simd_frames, k ;
+	int		ch, level ;
+
+	printf ("\tsimd_test (%d channel%s, SRC ratio = %6.4f) ..... ", channels, channels > 1 ? "s" : " ", src_ratio) ;
+	fflush (stdout) ;
+
+	for (ch = 0 ; ch < channels ; ch++)
+	{	freq = (200.0 + 33.333333333 * ch) / 44100.0 ;
+		gen_windowed_sines (1, &freq, 1.0, mono, BUFFER_LEN) ;
+		memcpy (planar + ch * BUFFER_LEN, mono, sizeof (mono)) ;
+		} ;
+
+	interleave_data (planar, input, BUFFER_LEN, channels) ;
+
+	scalar_frames = convert ("LIBSAMPLERATE_SIMD=none", converter, channels, src_ratio, input, scalar_out) ;
+
+	/* Both the SSE2 kernels and the best ones this processor supports. */
+	max_error = 0.0 ;
+	for (level = 0 ; level < ARRAY_LEN (simd_levels) ; level++)
+	{	simd_frames = convert (simd_levels [level], converter, channels, src_ratio, input, simd_out) ;
+
+		if (scalar_frames != simd_frames)
+		{	printf ("\n\nLine %d : scalar produced %ld frames, %s %ld.\n\n", __LINE__, scalar_frames, simd_levels [level], simd_frames) ;
+			exit (1) ;
+			} ;
+
+		for (k = 0 ; k < simd_frames * channels ; k++)
+			max_error = MAX (max_error, fabs (scalar_out [k] - simd_out [k])) ;
+		} ;
+
+	error_db = max_error > 0.0 ? 20.0 * log10 (max_error) : -999.0 ;
+
+	if (error_db > max_error_db)
+	{	printf ("\n\nLine %d : maximum difference %6.1f dB exceeds %6.1f dB.\n\n", __LINE__, error_db, max_error_db) ;
+		exit (1) ;
+		} ;
+
+	printf ("ok (%6.1f dB)\n", error_db) ;
+} /* simd_test */
+
+static long
+convert (const char *simd, int converter, int channels, double src_ratio, const float *input, float *output)
+{	static char env [64] ;
+	SRC_DATA data ;
+	int error ;
+
+	/* The setting is read when the converter is created. */
+	snprintf (env, sizeof (env), "%s", simd) ;
+	putenv (env) ;
+
+	data.data_in = input ;
+	data.input_frames = BUFFER_LEN ;
+	data.data_out = output ;
+	data.output_frames = ARRAY_LEN (scalar_out) / channels ;
+	data.src_ratio = src_ratio ;
+
+	if ((error = src_simple (&data, converter, channels)))
+	{	printf ("\n\nLine %d : %s\n\n", __LINE__, src_strerror (error)) ;
+		exit (1) ;
+		} ;
+
+	return data.output_frames_gen ;
+} /* convert */
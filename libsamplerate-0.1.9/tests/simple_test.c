@@ -41,6 +41,10 @@ main (void)
 	for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
 		simple_test (SRC_SINC_FASTEST, src_ratios [k]) ;
 
+	puts ("    Polyphase sinc interpolator :") ;
+	for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
+		simple_test (SRC_SINC_POLYPHASE, src_ratios [k]) ;
+
 	puts ("") ;
 
 	return 0 ;
@@ -56,6 +56,14 @@ main (void)
 	for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
 		stream_test (SRC_SINC_FASTEST, src_ratios [k]) ;
 
+
+	puts ("\n    Polyphase sinc interpolator:") ;
+	for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
+		init_term_test (SRC_SINC_POLYPHASE, src_ratios [k]) ;
+	puts ("") ;
+	for (k = 0 ; k < ARRAY_LEN (src_ratios) ; k++)
+		stream_test (SRC_SINC_POLYPHASE, src_ratios [k]) ;
+
 	puts ("") ;
 
 	simple_test (SRC_SINC_FASTEST) ;
@@ -106,6 +106,7 @@ single_run (void)
 	throughput_test (SRC_SINC_FASTEST, 0) ;
 	throughput_test (SRC_SINC_MEDIUM_QUALITY, 0) ;
 	throughput_test (SRC_SINC_BEST_QUALITY, 0) ;
+	throughput_test (SRC_SINC_POLYPHASE, 0) ;
 
 	puts ("") ;
 	return ;
@@ -114,7 +115,7 @@ single_run (void)
 static void
 multi_run (int run_count)
 {	long zero_order_hold = 0, linear = 0 ;
-	long sinc_fastest = 0, sinc_medium = 0, sinc_best = 0 ;
+	long sinc_fastest = 0, sinc_medium = 0, sinc_best = 0, sinc_polyphase = 0 ;
 	int k ;
 
 	puts (
@@ -129,6 +130,7 @@ multi_run (int run_count)
 		sinc_fastest =		throughput_test (SRC_SINC_FASTEST, sinc_fastest) ;
 		sinc_medium =		throughput_test (SRC_SINC_MEDIUM_QUALITY, sinc_medium) ;
 		sinc_best =			throughput_test (SRC_SINC_BEST_QUALITY, sinc_best) ;
+		sinc_polyphase =	throughput_test (SRC_SINC_POLYPHASE, sinc_polyphase) ;
 
 		puts ("") ;
 
@@ -148,6 +150,7 @@ multi_run (int run_count)
 	printf ("    %-30s    %10ld\n", src_get_name (SRC_SINC_FASTEST), sinc_fastest) ;
 	printf ("    %-30s    %10ld\n", src_get_name (SRC_SINC_MEDIUM_QUALITY), sinc_medium) ;
 	printf ("    %-30s    %10ld\n", src_get_name (SRC_SINC_BEST_QUALITY), sinc_best) ;
+	printf ("    %-30s    %10ld\n", src_get_name (SRC_SINC_POLYPHASE), sinc_polyphase) ;
 
 	puts ("") ;
 } /* multi_run */
@@ -0,0 +1,461 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Standalone throughput benchmark and verification of the PCMConverter kernels.
+ *
+ * Converts a music-like signal in every supported input sample size and channel
+ * count to 16-bit stereo with the helpers OutputReformatter used to chain
+ * together, with the scalar kernels and with the vector kernels.  Checks that
+ * vector output is identical to scalar output, that output of the conversions
+ * around the resampler is identical to the old helpers, and that dithered
+ * output stays within two steps of the old truncated output.  Six and eight
+ * channels, which the old helpers could not take, are downmixed and checked
+ * against a plain matrix product instead.  Reports MB/s of input consumed by
+ * each.
+ *
+ * Build (from this directory, after building libsamplerate):
+ *	cl /O2 /EHsc /DNOMINMAX /DRSOUTPUT_EXPORTS /I..\sdk /I..\src\core\impl
+ *		/I..\..\..\libsamplerate-0.1.9\src PCMConverterBenchmark.cpp
+ *		..\src\core\impl\PCMConverter.cpp ..\src\core\impl\OutputFormat.cpp
+ *		..\..\..\libsamplerate-0.1.9\out\Release\samplerate32.lib
+ */
+
+#include "OutputFormat.h"
+#include "PCMConverter.h"
+#include "Platform.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <samplerate.h>
+
+
+static const size_t FRAMES_PER_WRITE = 4096;
+static const size_t FRAME_COUNT = FRAMES_PER_WRITE * 108; // about 10 seconds
+static const int PASS_COUNT = 10;
+
+
+//------------------------------------------------------------------------------
+// helpers as OutputReformatter had them
+
+
+static void ccc_mono_to_stereo(const byte_t* const in, byte_t* const out,
+	const int sampleCount, const SampleSize& sampleSize)
+{
+	// work from back to front to support in-place conversion
+	for (int s = sampleCount - 1; s >= 0; --s)
+	{
+		// duplicate channel data byte by byte
+		for (int b = sampleSize - 1; b >= 0; --b)
+		{
+			out[(s * sampleSize * 2) + b] = in[(s * sampleSize) + b];
+			out[(s * sampleSize * 2) + sampleSize + b] = in[(s * sampleSize) + b];
+		}
+	}
+}
+
+
+static void src_any_to_float_array(const byte_t* const in, float* const out,
+	const int sampleCount, const SampleSize& sampleSize)
+{
+	const int signBit = 1 << ((sampleSize * 8) - 1);
+	const float scale = 1.0F * signBit;
+
+	for (int s = 0; s < sampleCount; ++s)
+	{
+		// load sample byte by byte
+		int sample = 0;
+		for (int b = sampleSize - 1; b >= 0; --b)
+		{
+			sample = (sample << 8) | in[(s * sampleSize) + b];
+		}
+
+		// extend sign bit if sample is negative
+		if (sampleSize < sizeof(int) && sample & signBit)
+		{
+			for (int b = sampleSize; b < sizeof(int); ++b)
+			{
+				sample |= 0xFF << (b * 8);
+			}
+		}
+
+		// scale sample into range [-1.0,1.0]
+		out[s] = sample / scale;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+
+
+// decaying harmonic notes with a little noise, as 24-bit samples
+static std::vector<int32_t> makeSignal()
+{
+	const double pi = 3.14159265358979323846;
+	std::vector<int32_t> samples(FRAME_COUNT * 2);
+	uint32_t random = 0x12345678;
+
+	for (size_t i = 0; i < FRAME_COUNT; ++i)
+	{
+		const double t = static_cast<double>(i) / 44100.0;
+		const double note = 110.0 * std::pow(2.0, static_cast<double>((i / 11025) % 24) / 12.0);
+		const double envelope = std::exp(-3.0 * static_cast<double>(i % 11025) / 11025.0);
+
+		double l = 0.0, r = 0.0;
+		for (int h = 1; h <= 6; ++h)
+		{
+			l += envelope * (2300000.0 / h) * std::sin(2.0 * pi * note * h * t);
+			r += envelope * (1800000.0 / h) * std::sin(2.0 * pi * note * h * t + 0.3 * h);
+		}
+
+		random = random * 1664525 + 1013904223;
+		samples[(i * 2)] = static_cast<int32_t>(l) + static_cast<int32_t>((random >> 8) % 4096) - 2048;
+		samples[(i * 2) + 1] = static_cast<int32_t>(r) + static_cast<int32_t>((random >> 20) % 4096) - 2048;
+	}
+
+	return samples;
+}
+
+
+// store the signal as little-endian samples of the given size and channel count
+static buffer_t encodeSignal(const std::vector<int32_t>& signal, const int sampleSize, const int channelCount)
+{
+	buffer_t pcm(FRAME_COUNT * channelCount * sampleSize);
+
+	for (size_t i = 0; i < FRAME_COUNT * channelCount; ++i)
+	{
+		// channels beyond the first two repeat the left and right signal
+		const int32_t sample24 = signal[(channelCount == 1 ? i * 2
+			: ((i / channelCount) * 2) + ((i % channelCount) % 2))];
+		const uint32_t sample = static_cast<uint32_t>(sampleSize == 4 ? sample24 * 256 : sample24 >> (24 - sampleSize * 8));
+
+		for (int b = 0; b < sampleSize; ++b)
+		{
+			pcm[(i * sampleSize) + b] = static_cast<byte_t>(sample >> (b * 8));
+		}
+	}
+
+	return pcm;
+}
+
+
+static double secondsSince(const std::chrono::steady_clock::time_point& start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static double megabytesPerSecond(const size_t bytes, const double seconds)
+{
+	return (static_cast<double>(bytes) * PASS_COUNT) / (seconds * 1024.0 * 1024.0);
+}
+
+
+// checks output against reference, returning false if any sample differs by more than tolerance
+static bool compare(const char* const what, const buffer_t& reference, const buffer_t& output, const int tolerance)
+{
+	const int16_t* const r = reinterpret_cast<const int16_t*>(&reference[0]);
+	const int16_t* const o = reinterpret_cast<const int16_t*>(&output[0]);
+
+	for (size_t s = 0; s < reference.size() / 2; ++s)
+	{
+		if (std::abs(r[s] - o[s]) > tolerance)
+		{
+			std::printf("    %s: sample %u is %d instead of %d\n",
+				what, static_cast<unsigned>(s), o[s], r[s]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+// sample size and channel count only, as when sample rate does not change
+static bool benchmarkDirect(const std::vector<int32_t>& signal, const int sampleSize, const int channelCount)
+{
+	const buffer_t pcm(encodeSignal(signal, sampleSize, channelCount));
+	const size_t inFrameSize = sampleSize * channelCount;
+	buffer_t legacy(FRAME_COUNT * 4), scalar(FRAME_COUNT * 4), vector(FRAME_COUNT * 4);
+	std::vector<float> floats(FRAMES_PER_WRITE * channelCount);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < PASS_COUNT; ++pass)
+	{
+		for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+		{
+			const byte_t* const in = &pcm[f * inFrameSize];
+			byte_t* const out = &legacy[f * 4];
+			const int sampleCount = static_cast<int>(FRAMES_PER_WRITE * channelCount);
+
+			if (sampleSize != 2)
+			{
+				src_any_to_float_array(in, &floats[0], sampleCount, SampleSize(sampleSize));
+				src_float_to_short_array(&floats[0], reinterpret_cast<short*>(out), sampleCount);
+			}
+			else
+			{
+				std::memcpy(out, in, sampleCount * 2);
+			}
+
+			if (channelCount == 1)
+			{
+				ccc_mono_to_stereo(out, out, sampleCount, SampleSize(2));
+			}
+		}
+	}
+	const double legacyTime = secondsSince(start);
+
+	double time[2];
+	for (int v = 0; v < 2; ++v)
+	{
+		PCMConverter converter(SampleSize(sampleSize), ChannelCount(channelCount),
+			PCMConverter::DownmixMatrix(), v != 0);
+		buffer_t& output = (v != 0 ? vector : scalar);
+
+		start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < PASS_COUNT; ++pass)
+		{
+			converter.reset();
+			for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+			{
+				converter.toStereo16(&pcm[f * inFrameSize], &output[f * 4], FRAMES_PER_WRITE);
+			}
+		}
+		time[v] = secondsSince(start);
+	}
+
+	std::printf("  %d-bit %-6s -> 16-bit stereo:  old %8.1f   scalar %8.1f   vector %8.1f  MB/s\n",
+		sampleSize * 8, channelCount == 1 ? "mono" : "stereo", megabytesPerSecond(pcm.size(), legacyTime),
+		megabytesPerSecond(pcm.size(), time[0]), megabytesPerSecond(pcm.size(), time[1]));
+
+	// wider samples are now dithered rather than truncated; the old helpers
+	// also turned 32-bit samples upside down, so those are not compared here
+	// or after conversion to floating-point format
+	bool passed = compare("vector vs scalar", scalar, vector, 0);
+	if (sampleSize < 4)
+	{
+		passed = compare("scalar vs old", legacy, scalar, sampleSize > 2 ? 2 : 0) && passed;
+	}
+
+	return passed;
+}
+
+
+// conversions to and from floating-point format around the resampler
+static bool benchmarkFloat(const std::vector<int32_t>& signal, const int sampleSize, const int channelCount)
+{
+	const buffer_t pcm(encodeSignal(signal, sampleSize, channelCount));
+	const size_t inFrameSize = sampleSize * channelCount;
+	const size_t sampleCount = FRAME_COUNT * channelCount;
+	std::vector<float> legacyFloats(sampleCount), floats[2];
+	buffer_t legacy(FRAME_COUNT * 4), output[2];
+	double toFloatTime[2], fromFloatTime[2];
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < PASS_COUNT; ++pass)
+	{
+		for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+		{
+			src_any_to_float_array(&pcm[f * inFrameSize], &legacyFloats[f * channelCount],
+				static_cast<int>(FRAMES_PER_WRITE * channelCount), SampleSize(sampleSize));
+		}
+	}
+	const double legacyToFloatTime = secondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < PASS_COUNT; ++pass)
+	{
+		for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+		{
+			byte_t* const out = &legacy[f * 4];
+			src_float_to_short_array(&legacyFloats[f * channelCount],
+				reinterpret_cast<short*>(out), static_cast<int>(FRAMES_PER_WRITE * channelCount));
+			if (channelCount == 1)
+			{
+				ccc_mono_to_stereo(out, out, static_cast<int>(FRAMES_PER_WRITE), SampleSize(2));
+			}
+		}
+	}
+	const double legacyFromFloatTime = secondsSince(start);
+
+	for (int v = 0; v < 2; ++v)
+	{
+		PCMConverter converter(SampleSize(sampleSize), ChannelCount(channelCount),
+			PCMConverter::DownmixMatrix(), v != 0);
+		floats[v].resize(sampleCount);
+		output[v].resize(FRAME_COUNT * 4);
+
+		start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < PASS_COUNT; ++pass)
+		{
+			for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+			{
+				converter.toFloat(&pcm[f * inFrameSize], &floats[v][f * channelCount], FRAMES_PER_WRITE);
+			}
+		}
+		toFloatTime[v] = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < PASS_COUNT; ++pass)
+		{
+			for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+			{
+				converter.floatToStereo16(&floats[v][f * channelCount], &output[v][f * 4], FRAMES_PER_WRITE);
+			}
+		}
+		fromFloatTime[v] = secondsSince(start);
+	}
+
+	std::printf("  %d-bit %-6s -> float:          old %8.1f   scalar %8.1f   vector %8.1f  MB/s\n",
+		sampleSize * 8, channelCount == 1 ? "mono" : "stereo", megabytesPerSecond(pcm.size(), legacyToFloatTime),
+		megabytesPerSecond(pcm.size(), toFloatTime[0]), megabytesPerSecond(pcm.size(), toFloatTime[1]));
+	std::printf("  float %-6s -> 16-bit stereo:  old %8.1f   scalar %8.1f   vector %8.1f  MB/s\n",
+		channelCount == 1 ? "mono" : "stereo", megabytesPerSecond(sampleCount * 4, legacyFromFloatTime),
+		megabytesPerSecond(sampleCount * 4, fromFloatTime[0]), megabytesPerSecond(sampleCount * 4, fromFloatTime[1]));
+
+	bool passed = true;
+	for (size_t s = 0; s < sampleCount && passed; ++s)
+	{
+		if (floats[0][s] != floats[1][s] || (sampleSize < 4 && floats[0][s] != legacyFloats[s]))
+		{
+			std::printf("    to float: sample %u differs\n", static_cast<unsigned>(s));
+			passed = false;
+		}
+	}
+	passed = compare("from float, vector vs scalar", output[0], output[1], 0) && passed;
+	if (sampleSize < 4)
+	{
+		passed = compare("from float, scalar vs old", legacy, output[0], 0) && passed;
+	}
+
+	return passed;
+}
+
+
+// conversion to floating-point format with downmix to stereo
+static bool benchmarkDownmix(const std::vector<int32_t>& signal, const int sampleSize, const int channelCount)
+{
+	const buffer_t pcm(encodeSignal(signal, sampleSize, channelCount));
+	const size_t inFrameSize = sampleSize * channelCount;
+	const PCMConverter::DownmixMatrix matrix(
+		PCMConverter::defaultDownmixMatrix(ChannelCount(channelCount)));
+	std::vector<float> reference(FRAME_COUNT * 2), floats[2];
+	std::vector<float> wide(FRAMES_PER_WRITE * channelCount);
+	double time[2];
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < PASS_COUNT; ++pass)
+	{
+		for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+		{
+			src_any_to_float_array(&pcm[f * inFrameSize], &wide[0],
+				static_cast<int>(FRAMES_PER_WRITE * channelCount), SampleSize(sampleSize));
+
+			for (size_t i = 0; i < FRAMES_PER_WRITE; ++i)
+			{
+				for (int o = 0; o < 2; ++o)
+				{
+					float sum = 0.0F;
+					for (int c = 0; c < channelCount; ++c)
+					{
+						sum += wide[(i * channelCount) + c] * matrix[(o * channelCount) + c];
+					}
+					reference[((f + i) * 2) + o] = sum;
+				}
+			}
+		}
+	}
+	const double referenceTime = secondsSince(start);
+
+	for (int v = 0; v < 2; ++v)
+	{
+		PCMConverter converter(SampleSize(sampleSize), ChannelCount(channelCount),
+			PCMConverter::DownmixMatrix(), v != 0);
+		floats[v].resize(FRAME_COUNT * 2);
+
+		start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < PASS_COUNT; ++pass)
+		{
+			for (size_t f = 0; f < FRAME_COUNT; f += FRAMES_PER_WRITE)
+			{
+				converter.toFloat(&pcm[f * inFrameSize], &floats[v][f * 2], FRAMES_PER_WRITE);
+			}
+		}
+		time[v] = secondsSince(start);
+	}
+
+	std::printf("  %d-bit %d-chan -> float stereo:  ref %8.1f   scalar %8.1f   vector %8.1f  MB/s\n",
+		sampleSize * 8, channelCount, megabytesPerSecond(pcm.size(), referenceTime),
+		megabytesPerSecond(pcm.size(), time[0]), megabytesPerSecond(pcm.size(), time[1]));
+
+	// the kernels sum channels in a different order than the plain product
+	bool passed = true;
+	for (size_t s = 0; s < FRAME_COUNT * 2 && passed; ++s)
+	{
+		if (floats[0][s] != floats[1][s] || std::fabs(floats[0][s] - reference[s]) > 1.0e-6F)
+		{
+			std::printf("    downmix: sample %u differs\n", static_cast<unsigned>(s));
+			passed = false;
+		}
+	}
+
+	return passed;
+}
+
+
+int main()
+{
+	const std::vector<int32_t> signal(makeSignal());
+	bool passed = true;
+
+	std::printf("%u frames in writes of %u frames, %d passes each\n",
+		static_cast<unsigned>(FRAME_COUNT), static_cast<unsigned>(FRAMES_PER_WRITE), PASS_COUNT);
+
+	std::printf("same sample rate:\n");
+	for (int sampleSize = 1; sampleSize <= 4; ++sampleSize)
+	{
+		for (int channelCount = 1; channelCount <= 2; ++channelCount)
+		{
+			passed = benchmarkDirect(signal, sampleSize, channelCount) && passed;
+		}
+	}
+
+	std::printf("around the resampler:\n");
+	for (int sampleSize = 1; sampleSize <= 4; ++sampleSize)
+	{
+		for (int channelCount = 1; channelCount <= 2; ++channelCount)
+		{
+			passed = benchmarkFloat(signal, sampleSize, channelCount) && passed;
+		}
+	}
+
+	std::printf("downmix:\n");
+	for (int sampleSize = 2; sampleSize <= 3; ++sampleSize)
+	{
+		passed = benchmarkDownmix(signal, sampleSize, 6) && passed;
+		passed = benchmarkDownmix(signal, sampleSize, 8) && passed;
+	}
+
+	std::printf(passed ? "all conversions verified\n" : "VERIFICATION FAILED\n");
+	return passed ? 0 : 1;
+}
@@ -23,6 +23,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 #include <Poco/AbstractObserver.h>
 #include <Poco/Notification.h>
 #include <Poco/SharedPtr.h>
@@ -40,6 +41,16 @@ public:
 	static void removeObserver(const Poco::AbstractObserver&);
 	static void postNotification(Poco::Notification::Ptr);
 
+public:
+	// how audio is compressed before it is sent to remote speakers
+	enum EncoderMode
+	{
+		ENCODE_FULL,     // full ALAC coefficient search (smallest packets)
+		ENCODE_FAST,     // ALAC fast mode (fixed coefficients)
+		ENCODE_RAW,      // uncompressed ALAC escape frames (least processor time)
+		ENCODE_ADAPTIVE  // switch among the above based on measured cost
+	};
+
 public:
 	bool getVolumeControl() const;
 	void setVolumeControl(bool);
@@ -47,6 +58,19 @@ public:
 	void setPlayerControl(bool);
 	bool getResetOnPause() const;
 	void setResetOnPause(bool);
+	EncoderMode getEncoderMode() const;
+	void setEncoderMode(EncoderMode);
+	// trade resilience to network loss for audio that plays sooner
+	bool getLowLatency() const;
+	void setLowLatency(bool);
+	// send each audio packet a second time to every device, as an unrequested
+	// resend; no receiver advertises this, so it is left to the user to opt in
+	bool getRedundantAudio() const;
+	void setRedundantAudio(bool);
+	// downmix coefficients for 3 to 8 channels, a row of left then a row of
+	// right ones; empty selects the standard coefficients
+	const std::vector<float>& getDownmixMatrix(int channelCount) const;
+	void setDownmixMatrix(int channelCount, const std::vector<float>&);
 
 	const DeviceInfoSet& devices() const;
 	DeviceInfoSet& devices();
@@ -63,6 +87,10 @@ private:
 	bool _volumeControl;
 	bool _playerControl;
 	bool _resetOnPause;
+	EncoderMode _encoderMode;
+	bool _lowLatency;
+	bool _redundantAudio;
+	std::map<int, std::vector<float>> _downmixMatrices;
 
 	DeviceInfoSet _devices;
 	std::set<std::string> _activatedDevices;
@@ -0,0 +1,177 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "Debugger.h"
+#include "DeviceConnector.h"
+#include <cassert>
+#include <utility>
+#include <Poco/Timestamp.h>
+#include <Poco/Net/IPAddress.h>
+
+
+using Poco::FastMutex;
+using Poco::Timespan;
+using Poco::Timestamp;
+using Poco::Net::IPAddress;
+using Poco::Net::SocketAddress;
+using Poco::Net::StreamSocket;
+
+
+DeviceConnector::DeviceConnector(const DeviceInfo& device)
+:
+	_device(device),
+	_devicePort(0),
+	_sdRef(0)
+{
+}
+
+
+DeviceConnector::~DeviceConnector()
+{
+	stopDiscovery();
+}
+
+
+bool DeviceConnector::connect(StreamSocket& socket, const Timespan& timeout)
+{
+	const Timestamp startTime;
+
+	try
+	{
+		SocketAddress address;
+		if (_device.isZeroConf())
+		{
+			if (!resolve(address, timeout))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			address = SocketAddress(_device.addr().first + ':' + _device.addr().second);
+		}
+
+		const Timespan remaining = timeout - Timespan(startTime.elapsed());
+		if (remaining <= 0)
+		{
+			return false;
+		}
+
+		socket.connect(address, remaining);
+		return true;
+	}
+	CATCH_ALL
+
+	return false;
+}
+
+
+bool DeviceConnector::resolve(SocketAddress& address, const Timespan& timeout)
+{
+	{
+		FastMutex::ScopedLock lock(_mutex);
+
+		// resolve host and port from service name and type
+		_sdRef = ServiceDiscovery::resolveService(
+			_device.addr().first, _device.addr().second, *this);
+		ServiceDiscovery::start(_sdRef);
+	}
+
+	const bool resolved = _resolved.tryWait(
+		static_cast<long>(timeout.totalMilliseconds()));
+
+	stopDiscovery();
+
+	if (resolved)
+	{
+		FastMutex::ScopedLock lock(_mutex);
+		address = _address;
+	}
+	return resolved;
+}
+
+
+void DeviceConnector::stopDiscovery()
+{
+	FastMutex::ScopedLock lock(_mutex);
+
+	if (_sdRef)
+	{
+		DNSServiceRef sdRef = 0;
+		std::swap(_sdRef, sdRef);
+		try
+		{
+			ServiceDiscovery::stop(sdRef);
+		}
+		CATCH_ALL
+	}
+}
+
+
+void DeviceConnector::onServiceResolved(
+	DNSServiceRef     sdRef,
+	const std::string name,
+	const std::string host,
+	const uint16_t    port,
+	const ServiceDiscovery::TXTRecord& txtRecord)
+{
+	assert(!host.empty());
+	assert(port > 0);
+
+	FastMutex::ScopedLock lock(_mutex);
+
+	if (sdRef != _sdRef)
+	{
+		return; // stopped while callback was pending
+	}
+
+	// stop service resolve activity
+	ServiceDiscovery::stop(sdRef);
+
+	_devicePort = port;
+
+	// query host record for IPv4 address
+	_sdRef = ServiceDiscovery::queryService(host, kDNSServiceType_A, *this);
+	ServiceDiscovery::start(_sdRef);
+}
+
+
+void DeviceConnector::onServiceQueried(
+	DNSServiceRef     sdRef,
+	const std::string rrname,
+	const uint16_t    rrtype,
+	const uint16_t    rdlen,
+	const void* const rdata,
+	const uint32_t    ttl)
+{
+	assert(rrtype == kDNSServiceType_A);
+	assert(rdlen == 4);
+	assert(rdata != 0);
+
+	FastMutex::ScopedLock lock(_mutex);
+
+	if (sdRef != _sdRef)
+	{
+		return; // stopped while callback was pending
+	}
+
+	// stop service query activity
+	ServiceDiscovery::stop(sdRef);
+	_sdRef = 0;
+
+	_address = SocketAddress(IPAddress(rdata, rdlen), _devicePort);
+	_resolved.set();
+}
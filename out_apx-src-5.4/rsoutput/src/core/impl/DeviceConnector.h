@@ -0,0 +1,67 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef DeviceConnector_h
+#define DeviceConnector_h
+
+
+#include "DeviceInfo.h"
+#include "ServiceDiscovery.h"
+#include "Uncopyable.h"
+#include <string>
+#include <Poco/Event.h>
+#include <Poco/Mutex.h>
+#include <Poco/Timespan.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/StreamSocket.h>
+
+
+/**
+ * Resolves a device's address and connects a socket to it without any user
+ * interface, so that several devices can be connected concurrently.  This
+ * is the same sequence ConnectDialog runs, minus the dialog.
+ */
+class DeviceConnector
+:
+	public ServiceDiscovery::ResolveListener,
+	public ServiceDiscovery::QueryListener,
+	private Uncopyable
+{
+public:
+	explicit DeviceConnector(const DeviceInfo&);
+	~DeviceConnector();
+
+	// returns true if socket was connected within the time limit
+	bool connect(Poco::Net::StreamSocket&, const Poco::Timespan& timeout);
+
+private:
+	bool resolve(Poco::Net::SocketAddress&, const Poco::Timespan& timeout);
+	void stopDiscovery();
+
+	void onServiceResolved(DNSServiceRef, std::string, std::string, uint16_t, const ServiceDiscovery::TXTRecord&);
+	void onServiceQueried(DNSServiceRef, std::string, uint16_t, uint16_t, const void*, uint32_t);
+
+	const DeviceInfo _device;
+
+	Poco::Event _resolved;
+	Poco::Net::SocketAddress _address;
+	uint16_t _devicePort;
+	DNSServiceRef _sdRef;
+	Poco::FastMutex _mutex;
+};
+
+
+#endif // DeviceConnector_h
@@ -16,6 +16,7 @@
 
 #include "ConnectDialog.h"
 #include "Debugger.h"
+#include "DeviceConnector.h"
 #include "DeviceManager.h"
 #include "MessageDialog.h"
 #include "Options.h"
@@ -27,11 +28,14 @@
 #include <stdexcept>
 #include <string>
 #include <Poco/Format.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
 #include <Poco/Timespan.h>
 #include <Poco/Timestamp.h>
 #include <Poco/Net/StreamSocket.h>
 
 
+using Poco::Thread;
 using Poco::Timespan;
 using Poco::Timestamp;
 using Poco::Net::StreamSocket;
@@ -41,9 +45,62 @@ using Poco::Net::StreamSocket;
 #define RAOP_ENGINE (*(*this).outputSinkForDevices().cast<RAOPEngine>())
 
 
+// time allowed to resolve and connect before falling back to connect dialog
+static const Timespan DIRECT_CONNECT_TIMEOUT(5, 0);
+
+
+static std::string audioJackMessage(const DeviceInfo& deviceInfo)
+{
+	return Poco::format("Audio jack on remote speakers \"%s\" is not connected.",
+		deviceInfo.name());
+}
+
+
+/**
+ * Opens one device on its own thread so that several devices can negotiate
+ * their sessions at the same time.  Tasks never show dialogs; whatever needs
+ * the user is left for the thread that started them.
+ */
+class DeviceManager::OpenTask
+:
+	public Poco::Runnable,
+	private Uncopyable
+{
+public:
+	OpenTask(DeviceManager& deviceManager, const DeviceInfo& deviceInfo,
+		const Device::SharedPtr& device, const bool testFirst)
+	:
+		_deviceManager(deviceManager),
+		_deviceInfo(deviceInfo),
+		_device(device),
+		_testFirst(testFirst),
+		_thread("DeviceManager::OpenTask")
+	{
+	}
+
+	void start() { _thread.start(*this); }
+	void join() { _thread.join(); }
+	bool isRunning() const { return _thread.isRunning(); }
+
+	const DeviceInfo& deviceInfo() const { return _deviceInfo; }
+	Device::SharedPtr device() const { return _device; }
+	bool testFirst() const { return _testFirst; }
+
+	void run() { _deviceManager.runOpenTask(*this); }
+
+private:
+	DeviceManager& _deviceManager;
+	const DeviceInfo _deviceInfo;
+	const Device::SharedPtr _device;
+	const bool _testFirst;
+	Thread _thread;
+};
+
+
 DeviceManager::DeviceManager(Player& player, OutputObserver& outputObserver)
 :
 	_volume(FLT_MIN),
+	_openingCount(0),
 	_player(player),
 	_outputObserver(outputObserver),
 	_deviceObserver(*this, &DeviceManager::onDeviceChanged)
@@ -55,6 +112,12 @@ DeviceManager::DeviceManager(Player& player, OutputObserver& outputObserver)
 DeviceManager::~DeviceManager()
 {
 	Options::removeObserver(_deviceObserver);
+
+	try
+	{
+		reapOpenTasks(true);
+	}
+	CATCH_ALL
 }
 
 
@@ -65,19 +128,105 @@ void DeviceManager::openDevices()
 	// hold reference to active options
 	const Options::SharedPtr options = Options::getOptions();
 
-	for (DeviceInfoSet::const_iterator it = options->devices().begin();
-		it != options->devices().end(); ++it)
+	reapOpenTasks(false);
+
+	// devices that failed or need the user after an earlier call returned
+	handleOpenResults(*options);
+
 	{
-		const DeviceInfo& deviceInfo = *it;
+		ScopedLock lock(_mutex);
 
-		if (options->isActivated(deviceInfo.name()))
+		for (DeviceInfoSet::const_iterator it = options->devices().begin();
+			it != options->devices().end(); ++it)
 		{
+			const DeviceInfo& deviceInfo = *it;
+
+			if (!options->isActivated(deviceInfo.name()))
+			{
+				continue;
+			}
+
 			anyDeviceActivated = true;
 
-			openDevice(deviceInfo);
+			if (isOpening(deviceInfo.name()))
+			{
+				continue;
+			}
+
+			const bool firstTime = (_devices.count(deviceInfo.name()) == 0);
+			if (!firstTime)
+			{
+				DeviceMap::mapped_type device = _devices[deviceInfo.name()];
+
+				if (device->isOpen())
+				{
+					if (_outputMetadata.length() > 0)
+					{
+						device->updateProgress(_outputInterval);
+					}
+					continue;
+				}
+			}
+
+			try
+			{
+				// keep device out of the map until open; loops over the map must
+				// not send requests to a device that is still negotiating
+				const Device::SharedPtr device = (firstTime
+					? createDevice(deviceInfo) : _devices[deviceInfo.name()]);
+				_devices.erase(deviceInfo.name());
+
+				if (_openingCount == 0 && !isAnyDeviceOpen())
+				{
+					// before opening the first device, init shared session state
+					RAOP_ENGINE.reinit(_outputInterval);
+				}
+
+				// remote speakers that passed the test before go straight to open
+				const bool testFirst = (firstTime && !isVerified(deviceInfo));
+
+				OpenTaskPtr task(new OpenTask(*this, deviceInfo, device, testFirst));
+				_openTasks.push_back(task);
+				_openingCount += 1;
+				task->start();
+			}
+			catch (const std::exception& ex)
+			{
+				Debugger::printException(ex, "Opening device " + deviceInfo.name());
+
+				Options::getOptions()->setActivated(deviceInfo.name(), false);
+				Options::postNotification(
+					new DeviceNotification(DeviceNotification::DEACTIVATE, deviceInfo));
+			}
 		}
 	}
 
+	// return as soon as the first device has attached, so playback starts
+	// without waiting for the slowest; later devices attach to the running
+	// engine, which forces a sync packet for each
+	for (;;)
+	{
+		{
+			ScopedLock lock(_mutex);
+
+			if (_openingCount == 0)
+			{
+				break;
+			}
+		}
+
+		if (isAnyDeviceOpen(false))
+		{
+			break;
+		}
+
+		_openTaskEvent.wait();
+	}
+
+	// tasks that finished by now are dealt with here; the rest are left for
+	// the next call
+	handleOpenResults(*options);
+
 	if (!anyDeviceActivated)
 	{
 		// limit rate of warning messages because some players will try to open
@@ -94,10 +243,52 @@ void DeviceManager::openDevices()
 }
 
 
+/**
+ * Shows messages that open tasks left for the user and retries devices they
+ * failed to open on the interactive path.  Runs on the calling thread only,
+ * since tasks never show dialogs.
+ */
+void DeviceManager::handleOpenResults(const Options& options)
+{
+	std::list<DeviceInfo> openFailures;
+	std::list<std::string> openMessages;
+	{
+		ScopedLock lock(_mutex);
+
+		openFailures.swap(_openFailures);
+		openMessages.swap(_openMessages);
+	}
+
+	for (std::list<std::string>::const_iterator it = openMessages.begin();
+		it != openMessages.end(); ++it)
+	{
+		MessageDialog(*it).doModal();
+	}
+
+	for (std::list<DeviceInfo>::const_iterator it = openFailures.begin();
+		it != openFailures.end(); ++it)
+	{
+		// user may have deselected device since its task failed
+		if (options.isActivated(it->name()))
+		{
+			// fall back to interactive path, which prompts for password and
+			// reports errors to the user
+			openDevice(*it);
+		}
+	}
+}
+
+
 void DeviceManager::closeDevices()
 {
+	// let devices still being opened finish so they get closed as well
+	reapOpenTasks(true);
+
 	ScopedLock lock(_mutex);
 
+	// failed devices are still retried on next open; messages are stale by then
+	_openMessages.clear();
+
 	for (DeviceMap::const_iterator it = _devices.begin(); it != _devices.end(); ++it)
 	{
 		DeviceMap::mapped_type device = it->second;
@@ -289,99 +480,127 @@ void DeviceManager::openDevice(const DeviceInfo& deviceInfo)
 	{
 		ScopedLock lock(_mutex);
 
+		// decide before testing, since a tested device counts as open
+		const bool firstSession = (_openingCount == 0 && !isAnyDeviceOpen());
+
+		// socket of tested session, which is handed on to open when still ready
+		StreamSocket testedSocket;
+		bool sessionReady = false;
+
 		if (_devices.count(deviceInfo.name()) == 0)
 		{
 			Device::SharedPtr device = createDevice(deviceInfo);
 
 			_devices[deviceInfo.name()] = device;
 
-			// run dialog box that will asynchronously resolve service name to
-			// host and port, resolve host to IP address and connect to address
-			// and port
-			ConnectDialog connectDialog(deviceInfo);
-			if (connectDialog.doModal() != 0)
+			// skip test for remote speakers that passed it before
+			if (!isVerified(deviceInfo))
 			{
-				const std::string message(Poco::format(
-					"Unable to connect to remote speakers \"%s\".",
-					deviceInfo.name()));
-				throw std::runtime_error(message);
-			}
-			StreamSocket& socket = connectDialog.socket();
+				// run dialog box that will asynchronously resolve service name to
+				// host and port, resolve host to IP address and connect to address
+				// and port
+				ConnectDialog connectDialog(deviceInfo);
+				if (connectDialog.doModal() != 0)
+				{
+					const std::string message(Poco::format(
+						"Unable to connect to remote speakers \"%s\".",
+						deviceInfo.name()));
+					throw std::runtime_error(message);
+				}
+				StreamSocket& socket = connectDialog.socket();
 
-			Debugger::printf("Connected to remote speakers \"%s\" at %s.",
-				deviceInfo.name().c_str(), socket.peerAddress().toString().c_str());
+				Debugger::printf("Connected to remote speakers \"%s\" at %s.",
+					deviceInfo.name().c_str(), socket.peerAddress().toString().c_str());
 
-			int returnCode = device->test(socket, true);
+				int returnCode = device->test(socket, true);
 
-			// check if remote speakers require a password
-			while (returnCode == 401)
-			{
-				Options::SharedPtr options = Options::getOptions();
-
-				// check for password in options
-				if (options->getPassword(deviceInfo.name()).empty())
+				// check if remote speakers require a password
+				while (returnCode == 401)
 				{
-					// prompt user for password
-					PasswordDialog passwordDialog(deviceInfo.name());
-					if (passwordDialog.doModal(_player.window()))
+					Options::SharedPtr options = Options::getOptions();
+
+					// check for password in options
+					if (options->getPassword(deviceInfo.name()).empty())
 					{
-						throw std::invalid_argument("No password entered.");
+						// prompt user for password
+						PasswordDialog passwordDialog(deviceInfo.name());
+						if (passwordDialog.doModal(_player.window()))
+						{
+							throw std::invalid_argument("No password entered.");
+						}
+
+						options->setPassword(deviceInfo.name(),
+							passwordDialog.password(),
+							passwordDialog.rememberPassword());
 					}
 
-					options->setPassword(deviceInfo.name(),
-						passwordDialog.password(),
-						passwordDialog.rememberPassword());
-				}
+					device->setPassword(options->getPassword(deviceInfo.name()));
 
-				device->setPassword(options->getPassword(deviceInfo.name()));
+					returnCode = device->test(socket, false);
 
-				returnCode = device->test(socket, false);
+					// check if password was not accepted
+					if (returnCode == 401)
+					{
+						options->clearPassword(deviceInfo.name());
+					}
 
-				// check if password was not accepted
-				if (returnCode == 401)
-				{
-					options->clearPassword(deviceInfo.name());
+					// repeat until password is accepted or user cancels
 				}
 
-				// repeat until password is accepted or user cancels
-			}
+				// check for initiation error
+				if (returnCode)
+				{
+					device->close();
 
-			device->close();
+					const std::string message(Poco::format(
+						"Unable to initiate session with remote speakers \"%s\".\r\n\r\n"
+						"Error code: %i", deviceInfo.name(), returnCode));
+					MessageDialog(message, MB_ICONERROR).doModal();
 
-			// check for initiation error
-			if (returnCode)
-			{
-				const std::string message(Poco::format(
-					"Unable to initiate session with remote speakers \"%s\".\r\n\r\n"
-					"Error code: %i", deviceInfo.name(), returnCode));
-				MessageDialog(message, MB_ICONERROR).doModal();
+					throw std::runtime_error(message);
+				}
+
+				_verifiedDevices.insert(verificationKey(deviceInfo));
 
-				throw std::runtime_error(message);
+				// keep authenticated session for open instead of reconnecting
+				sessionReady = device->isOpen();
+				if (sessionReady)
+				{
+					testedSocket = socket;
+				}
+				else
+				{
+					device->close();
+				}
 			}
 		}
 
 		DeviceMap::mapped_type device = _devices[deviceInfo.name()];
 
-		if (!device->isOpen())
+		if (sessionReady || !device->isOpen())
 		{
-			if (!isAnyDeviceOpen())
+			if (firstSession)
 			{
 				// before opening the first device, init shared session state
 				RAOP_ENGINE.reinit(_outputInterval);
 			}
 
-			// run dialog box that will asynchronously resolve service name to
-			// host and port, resolve host to IP address and connect to address
-			// and port
-			ConnectDialog connectDialog(deviceInfo);
-			if (connectDialog.doModal() != 0)
+			StreamSocket socket(testedSocket);
+			if (!sessionReady)
 			{
-				const std::string message(Poco::format(
-					"Unable to connect to remote speakers \"%s\".",
-					deviceInfo.name()));
-				throw std::runtime_error(message);
+				// run dialog box that will asynchronously resolve service name to
+				// host and port, resolve host to IP address and connect to address
+				// and port
+				ConnectDialog connectDialog(deviceInfo);
+				if (connectDialog.doModal() != 0)
+				{
+					const std::string message(Poco::format(
+						"Unable to connect to remote speakers \"%s\".",
+						deviceInfo.name()));
+					throw std::runtime_error(message);
+				}
+				socket = connectDialog.socket();
 			}
-			StreamSocket& socket = connectDialog.socket();
 
 			AudioJackStatus audioJackStatus = AUDIO_JACK_CONNECTED;
 
@@ -425,6 +644,9 @@ void DeviceManager::openDevice(const DeviceInfo& deviceInfo)
 			// check for negotiation error
 			if (returnCode)
 			{
+				// test again next time in case remote speakers have changed
+				_verifiedDevices.erase(verificationKey(deviceInfo));
+
 				if (returnCode == 453)
 				{
 					const std::string message(Poco::format(
@@ -444,22 +666,13 @@ void DeviceManager::openDevice(const DeviceInfo& deviceInfo)
 					throw std::runtime_error(message);
 				}
 			}
-			else if (audioJackStatus == AUDIO_JACK_DISCONNECTED)
-			{
-				const std::string message(Poco::format(
-					"Audio jack on remote speakers \"%s\" is not connected.",
-					deviceInfo.name()));
-				MessageDialog(message).doModal();
-			}
-
-			if (deviceInfo.type() == DeviceInfo::AVR) device->getVolume();
-			if (volumeSet()) device->setVolume(_volume, 0);
 
-			if (_outputMetadata.length() > 0 || !_outputMetadata.title().empty())
+			if (audioJackStatus == AUDIO_JACK_DISCONNECTED)
 			{
-				device->updateMetadata(_outputMetadata);
-				device->updateProgress(_outputInterval);
+				MessageDialog(audioJackMessage(deviceInfo)).doModal();
 			}
+
+			onDeviceOpened(deviceInfo, *device);
 		}
 		else if (_outputMetadata.length() > 0)
 		{
@@ -476,6 +689,207 @@ void DeviceManager::openDevice(const DeviceInfo& deviceInfo)
 }
 
 
+void DeviceManager::onDeviceOpened(const DeviceInfo& deviceInfo, Device& device)
+{
+	if (deviceInfo.type() == DeviceInfo::AVR) device.getVolume();
+	if (volumeSet()) device.setVolume(_volume, 0);
+
+	if (_outputMetadata.length() > 0 || !_outputMetadata.title().empty())
+	{
+		device.updateMetadata(_outputMetadata);
+		device.updateProgress(_outputInterval);
+	}
+}
+
+
+void DeviceManager::runOpenTask(OpenTask& task)
+{
+	const DeviceInfo& deviceInfo = task.deviceInfo();
+	Device::SharedPtr device = task.device();
+
+	int returnCode = -1;
+	AudioJackStatus audioJackStatus = AUDIO_JACK_CONNECTED;
+	try
+	{
+		returnCode = openDeviceDirectly(deviceInfo, *device, task.testFirst(), audioJackStatus);
+	}
+	CATCH_ALL
+
+	if (returnCode != 0)
+	{
+		Debugger::printf("Opening remote speakers \"%s\" directly returned %i; "
+			"leaving it for connect dialog.", deviceInfo.name().c_str(), returnCode);
+
+		try
+		{
+			// release partially negotiated session before starting over
+			device->close();
+		}
+		CATCH_ALL
+	}
+
+	{
+		ScopedLock lock(_mutex);
+
+		_openingCount -= 1;
+
+		if (returnCode == 0)
+		{
+			Debugger::printf("Opened remote speakers \"%s\" without user interaction.",
+				deviceInfo.name().c_str());
+
+			_devices[deviceInfo.name()] = device;
+			_verifiedDevices.insert(verificationKey(deviceInfo));
+			try
+			{
+				onDeviceOpened(deviceInfo, *device);
+			}
+			CATCH_ALL
+
+			if (audioJackStatus == AUDIO_JACK_DISCONNECTED)
+			{
+				_openMessages.push_back(audioJackMessage(deviceInfo));
+			}
+		}
+		else
+		{
+			// let interactive path test again in case remote speakers have changed
+			_verifiedDevices.erase(verificationKey(deviceInfo));
+			_openFailures.push_back(deviceInfo);
+		}
+	}
+	_openTaskEvent.set();
+}
+
+
+/**
+ * Resolves, connects and negotiates a session with remote speakers using
+ * any remembered password but no dialogs.
+ *
+ * @return zero on success; non-zero on failure
+ */
+int DeviceManager::openDeviceDirectly(const DeviceInfo& deviceInfo, Device& device,
+	const bool testFirst, AudioJackStatus& audioJackStatus)
+{
+	const std::string password(Options::getOptions()->getPassword(deviceInfo.name()));
+
+	StreamSocket socket;
+	if (!DeviceConnector(deviceInfo).connect(socket, DIRECT_CONNECT_TIMEOUT))
+	{
+		return -1;
+	}
+
+	Debugger::printf("Connected to remote speakers \"%s\" at %s.",
+		deviceInfo.name().c_str(), socket.peerAddress().toString().c_str());
+
+	int returnCode;
+
+	if (testFirst)
+	{
+		returnCode = device.test(socket, true);
+		if (returnCode == 401 && !password.empty())
+		{
+			device.setPassword(password);
+			returnCode = device.test(socket, false);
+		}
+
+		if (returnCode)
+		{
+			device.close();
+			return returnCode;
+		}
+
+		// keep authenticated session for open instead of reconnecting
+		if (!device.isOpen())
+		{
+			device.close();
+
+			socket = StreamSocket();
+			if (!DeviceConnector(deviceInfo).connect(socket, DIRECT_CONNECT_TIMEOUT))
+			{
+				return -1;
+			}
+		}
+	}
+
+	// negotiate session parameters with remote speakers
+	returnCode = device.open(socket, audioJackStatus);
+	if (returnCode == 401 && !password.empty())
+	{
+		device.setPassword(password);
+		returnCode = device.open(socket, audioJackStatus);
+	}
+
+	return returnCode;
+}
+
+
+std::string DeviceManager::verificationKey(const DeviceInfo& deviceInfo)
+{
+	return Poco::format("%s|%d|%s:%s", deviceInfo.name(), (int) deviceInfo.type(),
+		deviceInfo.addr().first, deviceInfo.addr().second);
+}
+
+
+bool DeviceManager::isVerified(const DeviceInfo& deviceInfo) const
+{
+	return (_verifiedDevices.count(verificationKey(deviceInfo)) != 0);
+}
+
+
+bool DeviceManager::isOpening(const std::string& deviceName) const
+{
+	for (std::list<OpenTaskPtr>::const_iterator it = _openTasks.begin();
+		it != _openTasks.end(); ++it)
+	{
+		if ((*it)->isRunning() && (*it)->deviceInfo().name() == deviceName)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void DeviceManager::reapOpenTasks(const bool wait)
+{
+	std::list<OpenTaskPtr> tasks;
+
+	{
+		ScopedLock lock(_mutex);
+
+		if (wait)
+		{
+			tasks.swap(_openTasks);
+		}
+		else
+		{
+			std::list<OpenTaskPtr>::iterator it = _openTasks.begin();
+			while (it != _openTasks.end())
+			{
+				if (!(*it)->isRunning())
+				{
+					tasks.push_back(*it);
+					it = _openTasks.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+	}
+
+	// join without holding mutex, which tasks need in order to finish
+	for (std::list<OpenTaskPtr>::const_iterator it = tasks.begin();
+		it != tasks.end(); ++it)
+	{
+		(*it)->join();
+	}
+}
+
+
 void DeviceManager::onDeviceChanged(DeviceNotification* const notification)
 {
 	try
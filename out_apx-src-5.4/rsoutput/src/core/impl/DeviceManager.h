@@ -28,11 +28,15 @@
 #include "Platform.h"
 #include "Player.h"
 #include "Uncopyable.h"
+#include <list>
 #include <map>
+#include <set>
 #include <cfloat>
 #include <string>
+#include <Poco/Event.h>
 #include <Poco/Mutex.h>
 #include <Poco/Observer.h>
+#include <Poco/SharedPtr.h>
 
 
 class DeviceManager
@@ -62,8 +66,18 @@ private:
 	Device::SharedPtr createDevice(const DeviceInfo&);
 	void destroyDevice(const DeviceInfo&);
 	void openDevice(const DeviceInfo&);
+	void onDeviceOpened(const DeviceInfo&, Device&);
 	bool volumeSet() const;
 
+	class OpenTask;
+	void runOpenTask(OpenTask&);
+	void handleOpenResults(const class Options&);
+	int openDeviceDirectly(const DeviceInfo&, Device&, bool firstTime, AudioJackStatus&);
+	bool isOpening(const std::string& deviceName) const;
+	static std::string verificationKey(const DeviceInfo&);
+	bool isVerified(const DeviceInfo&) const;
+	void reapOpenTasks(bool wait);
+
 	void onDeviceChanged(DeviceNotification*);
 
 private:
@@ -84,6 +98,22 @@ private:
 	Player& _player;
 	float _volume;
 
+	// devices being connected concurrently; counts guarded by mutex
+	typedef Poco::SharedPtr<OpenTask> OpenTaskPtr;
+	std::list<OpenTaskPtr> _openTasks;
+	size_t _openingCount; // tasks not yet finished
+	Poco::Event _openTaskEvent;
+
+	// what tasks leave for the calling thread, which alone shows dialogs:
+	// devices to retry on the interactive path and messages for the user;
+	// handled by the next call to open devices once they are in
+	std::list<DeviceInfo> _openFailures;
+	std::list<std::string> _openMessages;
+
+	// remote speakers that passed the connection test, so reopening them
+	// skips it; keyed by name, type and address
+	std::set<std::string> _verifiedDevices;
+
 	mutable Poco::FastMutex _mutex;
 	typedef const Poco::FastMutex::ScopedLock ScopedLock;
 };
@@ -131,6 +131,13 @@ void DeviceUtils::toggle(const std::string& which)
 	opts->setVolumeControl(options->getVolumeControl());
 	opts->setPlayerControl(options->getPlayerControl());
 	opts->setResetOnPause(options->getResetOnPause());
+	opts->setEncoderMode(options->getEncoderMode());
+	opts->setLowLatency(options->getLowLatency());
+	opts->setRedundantAudio(options->getRedundantAudio());
+	for (int channelCount = 3; channelCount <= 8; ++channelCount)
+	{
+		opts->setDownmixMatrix(channelCount, options->getDownmixMatrix(channelCount));
+	}
 
 	// transfer passwords
 	for (DeviceInfoSet::const_iterator it = opts->devices().begin();
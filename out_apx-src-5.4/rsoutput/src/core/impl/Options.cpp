@@ -23,6 +23,7 @@
 #include "Plugin.h"
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <stdexcept>
 #include <utility>
 #include <openssl/evp.h>
@@ -177,6 +178,71 @@ void Options::setResetOnPause(const bool state)
 }
 
 
+Options::EncoderMode Options::getEncoderMode() const
+{
+	return _encoderMode;
+}
+
+
+void Options::setEncoderMode(const EncoderMode mode)
+{
+	_encoderMode = mode;
+}
+
+
+bool Options::getLowLatency() const
+{
+	return _lowLatency;
+}
+
+
+void Options::setLowLatency(const bool state)
+{
+	_lowLatency = state;
+}
+
+
+bool Options::getRedundantAudio() const
+{
+	return _redundantAudio;
+}
+
+
+void Options::setRedundantAudio(const bool state)
+{
+	_redundantAudio = state;
+}
+
+
+const std::vector<float>& Options::getDownmixMatrix(const int channelCount) const
+{
+	static const std::vector<float> emptyMatrix;
+
+	std::map<int, std::vector<float>>::const_iterator pos =
+		_downmixMatrices.find(channelCount);
+	return (pos != _downmixMatrices.end() ? pos->second : emptyMatrix);
+}
+
+
+void Options::setDownmixMatrix(const int channelCount, const std::vector<float>& matrix)
+{
+	if (matrix.empty())
+	{
+		_downmixMatrices.erase(channelCount);
+	}
+	else
+	{
+		if (channelCount < 3 || channelCount > 8
+			|| matrix.size() != static_cast<size_t>(channelCount * 2))
+		{
+			throw std::invalid_argument(
+				"channelCount < 3 || channelCount > 8 || matrix.size() != channelCount * 2");
+		}
+		_downmixMatrices[channelCount] = matrix;
+	}
+}
+
+
 const DeviceInfoSet& Options::devices() const
 {
 	return _devices;
@@ -276,6 +342,10 @@ bool operator ==(const Options& lhs, const Options& rhs)
 	if (lhs.getVolumeControl() != rhs.getVolumeControl()
 		|| lhs.getPlayerControl() != rhs.getPlayerControl()
 		|| lhs.getResetOnPause() != rhs.getResetOnPause()
+		|| lhs.getEncoderMode() != rhs.getEncoderMode()
+		|| lhs.getLowLatency() != rhs.getLowLatency()
+		|| lhs.getRedundantAudio() != rhs.getRedundantAudio()
+		|| lhs._downmixMatrices != rhs._downmixMatrices
 		|| lhs._activatedDevices.size() != rhs._activatedDevices.size()
 		|| !std::equal(lhs._activatedDevices.begin(), lhs._activatedDevices.end(),
 				rhs._activatedDevices.begin())
@@ -322,9 +392,73 @@ void OptionsUtils::loadOptions(const std::string& iniFilePath)
 	Debugger::printf(
 		"Read 'ResetOnPause' value '%i'.", (int) options->getResetOnPause());
 
+	// read encoder mode integer
+	const unsigned int encoderMode = GetPrivateProfileIntA(Plugin::name().c_str(),
+		"EncoderMode", Options::ENCODE_FULL, iniFilePath.c_str());
+	options->setEncoderMode(encoderMode <= Options::ENCODE_ADAPTIVE
+		? Options::EncoderMode(encoderMode) : Options::ENCODE_FULL);
+	Debugger::printf(
+		"Read 'EncoderMode' value '%u'.", (unsigned int) options->getEncoderMode());
+
+	// read low latency flag
+	options->setLowLatency(0 != GetPrivateProfileIntA(
+		Plugin::name().c_str(), "LowLatency", 0, iniFilePath.c_str()));
+	Debugger::printf(
+		"Read 'LowLatency' value '%i'.", (int) options->getLowLatency());
+
+	// read redundant audio flag
+	options->setRedundantAudio(0 != GetPrivateProfileIntA(
+		Plugin::name().c_str(), "RedundantAudio", 0, iniFilePath.c_str()));
+	Debugger::printf(
+		"Read 'RedundantAudio' value '%i'.", (int) options->getRedundantAudio());
+
 	int parameterValueLength;
 	char parameterValue[128];
 
+	for (int channelCount = 3; channelCount <= 8; ++channelCount)
+	{
+		// read downmix coefficients string
+		char matrixValue[256];
+		parameterValueLength = GetPrivateProfileStringA(Plugin::name().c_str(),
+			Poco::format("DownmixMatrix%i", channelCount).c_str(), NULL,
+			matrixValue, sizeof(matrixValue), iniFilePath.c_str());
+		if (parameterValueLength <= 0)
+		{
+			continue;
+		}
+		Debugger::printf("Read 'DownmixMatrix%i' value '%s'.", channelCount, matrixValue);
+
+		// parse comma-separated coefficients, left row then right row
+		std::vector<float> matrix;
+		const char* next = matrixValue;
+		for (;;)
+		{
+			char* end;
+			const float coefficient = static_cast<float>(std::strtod(next, &end));
+			if (end == next)
+			{
+				break;
+			}
+			matrix.push_back(coefficient);
+
+			while (*end == ' ') ++end;
+			if (*end != ',')
+			{
+				next = end;
+				break;
+			}
+			next = end + 1;
+		}
+
+		if (*next != '\0' || matrix.size() != static_cast<size_t>(channelCount * 2))
+		{
+			Debugger::printf("Ignored malformed 'DownmixMatrix%i' value.", channelCount);
+			continue;
+		}
+
+		options->setDownmixMatrix(channelCount, matrix);
+	}
+
 	for (int index = 1; index < 256; ++index)
 	{
 		// read device type integer
@@ -466,6 +600,50 @@ void OptionsUtils::saveOptions(const std::string& iniFilePath)
 	Debugger::printf(
 		"Wrote 'ResetOnPause' value '%i'.", (int) options->getResetOnPause());
 
+	// write encoder mode integer
+	WritePrivateProfileStringA(Plugin::name().c_str(), "EncoderMode",
+		Poco::format("%u", static_cast<unsigned int>(options->getEncoderMode())).c_str(),
+		iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'EncoderMode' value '%u'.", (unsigned int) options->getEncoderMode());
+
+	// write low latency flag
+	WritePrivateProfileStringA(Plugin::name().c_str(), "LowLatency",
+		Poco::format("%b", options->getLowLatency()).c_str(),
+		iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'LowLatency' value '%i'.", (int) options->getLowLatency());
+
+	// write redundant audio flag
+	WritePrivateProfileStringA(Plugin::name().c_str(), "RedundantAudio",
+		Poco::format("%b", options->getRedundantAudio()).c_str(),
+		iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'RedundantAudio' value '%i'.", (int) options->getRedundantAudio());
+
+	for (int channelCount = 3; channelCount <= 8; ++channelCount)
+	{
+		const std::vector<float>& matrix = options->getDownmixMatrix(channelCount);
+		if (matrix.empty())
+		{
+			continue;
+		}
+
+		// write downmix coefficients string
+		std::string matrixValue;
+		for (size_t i = 0; i < matrix.size(); ++i)
+		{
+			if (i > 0) matrixValue += ',';
+			matrixValue += Poco::format("%.6f", static_cast<double>(matrix[i]));
+		}
+
+		WritePrivateProfileStringA(Plugin::name().c_str(),
+			Poco::format("DownmixMatrix%i", channelCount).c_str(),
+			matrixValue.c_str(), iniFilePath.c_str());
+		Debugger::printf(
+			"Wrote 'DownmixMatrix%i' value '%s'.", channelCount, matrixValue.c_str());
+	}
+
 	int index = 0;
 	for (DeviceInfoSet::const_iterator it = options->devices().begin();
 		it != options->devices().end(); ++it)
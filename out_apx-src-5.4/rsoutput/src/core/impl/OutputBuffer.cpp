@@ -20,37 +20,100 @@
 #include <cassert>
 #include <cstring>
 #include <stdexcept>
+#include <Poco/Timestamp.h>
 
 
 static const size_t BUFFER_CAPACITY = 32 * 1024;
 
+// longest a flush blocks for the output sink to make room (in milliseconds)
+static const long FLUSH_WAIT_TIMEOUT = 12;
+
+
+// maps the same memory at two adjacent address ranges, so that reads and writes
+// running past the end of the first continue at the start of the second
+static byte_t* mapMirroredBuffer(const size_t size, HANDLE& mapping)
+{
+	mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		0, static_cast<DWORD>(size), NULL);
+	if (mapping == NULL)
+	{
+		throw std::runtime_error(Platform::Error::describeLast());
+	}
+
+	for (int attempt = 0; attempt < 16; ++attempt)
+	{
+		// find room for both views, then release it and map into it; another
+		// thread may take the range in between, in which case try again
+		byte_t* const base = static_cast<byte_t*>(
+			VirtualAlloc(NULL, size * 2, MEM_RESERVE, PAGE_NOACCESS));
+		if (base == NULL)
+		{
+			break;
+		}
+		VirtualFree(base, 0, MEM_RELEASE);
+
+		if (MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, base) == NULL)
+		{
+			continue;
+		}
+		if (MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, base + size) != NULL)
+		{
+			return base;
+		}
+		UnmapViewOfFile(base);
+	}
+
+	const std::string error = Platform::Error::describeLast();
+	CloseHandle(mapping);
+	throw std::runtime_error(error);
+}
+
 
 OutputBuffer::OutputBuffer(OutputSink::SharedPtr outputSink)
 :
-	_buffer(BUFFER_CAPACITY),
-	_bufferAvailability(_buffer.size()),
+	_buffer(NULL),
+	_bufferSize(0),
+	_bufferMapping(NULL),
+	_bufferAvailability(BUFFER_CAPACITY),
 	_bufferReadIndex(0),
 	_bufferWriteIndex(0),
+	_flushPending(false),
 	_outputSink(outputSink)
 {
+	// views must start on allocation boundaries, so round size up to one
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	const size_t granularity = systemInfo.dwAllocationGranularity;
+	_bufferSize = ((BUFFER_CAPACITY + granularity - 1) / granularity) * granularity;
+
+	_buffer = mapMirroredBuffer(_bufferSize, _bufferMapping);
 }
 
 
 OutputBuffer::~OutputBuffer()
 {
+	UnmapViewOfFile(_buffer + _bufferSize);
+	UnmapViewOfFile(_buffer);
+	CloseHandle(_bufferMapping);
 }
 
 
 time_t OutputBuffer::latency(const OutputFormat& format) const
 {
-	return _outputSink->latency(format);
+	// add time to play what is waiting in the ring
+	const size_t bytesPerSecond =
+		format.sampleRate() * format.sampleSize() * format.channelCount();
+	const time_t bufferLatency = static_cast<time_t>(
+		((BUFFER_CAPACITY - _bufferAvailability) * 1000) / bytesPerSecond);
+
+	return bufferLatency + _outputSink->latency(format);
 }
 
 size_t OutputBuffer::buffered() const
 {
 	checkOutputSink();
 
-	return (_buffer.size() - _bufferAvailability) + _outputSink->buffered();
+	return (BUFFER_CAPACITY - _bufferAvailability) + _outputSink->buffered();
 }
 
 
@@ -70,21 +133,31 @@ void OutputBuffer::write(const byte_t* const buffer, const size_t length)
 			"buffer == NULL || length == 0 || length > _bufferAvailability");
 	}
 
-	// write data to buffer
-	if (_bufferWriteIndex < _bufferReadIndex
-		|| length <= _buffer.size() - _bufferWriteIndex)
+	_flushPending = false;
+
+	size_t offset = 0;
+
+	// while nothing is buffered, hand whole writes of the size the output sink
+	// asks for straight from the caller's memory
+	if (_bufferAvailability == BUFFER_CAPACITY)
 	{
-		std::memcpy(&_buffer[_bufferWriteIndex], buffer, length);
+		for (size_t canWrite = _outputSink->canWrite();
+			canWrite > 0 && length - offset >= canWrite;
+			canWrite = _outputSink->canWrite())
+		{
+			_outputSink->write(buffer + offset, canWrite);
+			offset += canWrite;
+		}
 	}
-	else
+
+	// write remaining data to buffer
+	if (offset < length)
 	{
-		const size_t part1 = _buffer.size() - _bufferWriteIndex;
-		std::memcpy(&_buffer[_bufferWriteIndex], buffer, part1);
-		std::memcpy(&_buffer[0], buffer + part1, length - part1);
-	}
+		std::memcpy(&_buffer[_bufferWriteIndex], buffer + offset, length - offset);
 
-	_bufferAvailability -= length;
-	_bufferWriteIndex = (_bufferWriteIndex + length) % _buffer.size();
+		_bufferAvailability -= (length - offset);
+		_bufferWriteIndex = (_bufferWriteIndex + (length - offset)) % _bufferSize;
+	}
 
 	writeToOutputSink();
 }
@@ -92,25 +165,63 @@ void OutputBuffer::write(const byte_t* const buffer, const size_t length)
 
 void OutputBuffer::flush()
 {
-	writeToOutputSink(true);
+	// players also flush when they merely pause writing, so the first flush
+	// only pushes out whole packets and carries a partial one forward; it is
+	// written short when flushed again with nothing written in between
+	writeToOutputSink(_flushPending);
+	_flushPending = true;
 }
 
 
 void OutputBuffer::reset()
 {
-	_bufferAvailability = _buffer.size();
+	_bufferAvailability = BUFFER_CAPACITY;
 	_bufferReadIndex = 0;
 	_bufferWriteIndex = 0;
+	_flushPending = false;
 	_outputSink->reset();
 }
 
 
+bool OutputBuffer::waitForSpace(const long milliseconds)
+{
+	if (_bufferAvailability == 0 && _outputSink->waitForSpace(milliseconds))
+	{
+		writeToOutputSink();
+	}
+
+	return (_bufferAvailability > 0);
+}
+
+
+bool OutputBuffer::waitUntilDrained(const long milliseconds)
+{
+	const Poco::Timestamp startTime;
+
+	// write out everything buffered, a partial packet included, as output
+	// sink makes room for it
+	while (_bufferAvailability < BUFFER_CAPACITY)
+	{
+		const long remaining = milliseconds - static_cast<long>(startTime.elapsed() / 1000);
+		if (remaining <= 0 || !_outputSink->waitForSpace(remaining))
+		{
+			return false;
+		}
+
+		writeToOutputSink(true);
+	}
+
+	const long remaining = milliseconds - static_cast<long>(startTime.elapsed() / 1000);
+	return (remaining > 0 && _outputSink->waitUntilDrained(remaining));
+}
+
+
 //------------------------------------------------------------------------------
 
 
 void OutputBuffer::checkOutputSink() const
 {
-	const size_t canRead = _buffer.size() - _bufferAvailability;
+	const size_t canRead = BUFFER_CAPACITY - _bufferAvailability;
 
 	if (canRead > 0 && canRead >= _outputSink->canWrite())
 	{
@@ -122,47 +233,27 @@ void OutputBuffer::checkOutputSink() const
 
 void OutputBuffer::writeToOutputSink(const bool flushBuffer)
 {
-	unsigned sleeps = 0;
 repeat:
-	const size_t canRead = _buffer.size() - _bufferAvailability;
+	const size_t canRead = BUFFER_CAPACITY - _bufferAvailability;
 	const size_t canWrite = _outputSink->canWrite();
 
 	if (canRead > 0 && ((canWrite > 0 && canRead >= canWrite) || flushBuffer))
 	{
 		if (canWrite == 0)
 		{
-			if (sleeps++ > 11) return;
-			Sleep(1); goto repeat;
+			// block until sender frees a packet rather than polling for it
+			if (!_outputSink->waitForSpace(FLUSH_WAIT_TIMEOUT)) return;
+			goto repeat;
 		}
-		sleeps = 0;
 
-		buffer_t::const_pointer ptr;
 		const size_t doWrite = std::min(canRead, canWrite);
 
-		// check if data to be written is contiguous or not
-		if (_bufferReadIndex < _bufferWriteIndex
-			|| doWrite <= _buffer.size() - _bufferReadIndex)
-		{
-			ptr = &_buffer[_bufferReadIndex];
-		}
-		else
-		{
-			if (_temp.size() < doWrite)
-			{
-				_temp.resize(doWrite);
-			}
-
-			const size_t part1 = _buffer.size() - _bufferReadIndex;
-			std::memcpy(&_temp[0], &_buffer[_bufferReadIndex], part1);
-			std::memcpy(&_temp[part1], &_buffer[0], doWrite - part1);
-
-			ptr = &_temp[0];
-		}
-
-		_outputSink->write(ptr, doWrite);
+		// data to be written is contiguous even where it wraps around, since
+		// the second view of the ring follows right after the first
+		_outputSink->write(&_buffer[_bufferReadIndex], doWrite);
 
 		_bufferAvailability += doWrite;
-		_bufferReadIndex = (_bufferReadIndex + doWrite) % _buffer.size();
+		_bufferReadIndex = (_bufferReadIndex + doWrite) % _bufferSize;
 
 		goto repeat;
 	}
@@ -40,14 +40,22 @@ public:
 	void flush();
 	void reset();
 
+	bool waitForSpace(long milliseconds);
+	bool waitUntilDrained(long milliseconds);
+
 private:
 	void checkOutputSink() const;
 	void writeToOutputSink(bool flushBuffer = false);
 
-	buffer_t _buffer, _temp;
+	/** ring memory, mapped twice in a row so that any span is contiguous */
+	byte_t* _buffer;
+	size_t _bufferSize;
+	HANDLE _bufferMapping;
+
 	size_t _bufferAvailability;
 	size_t _bufferReadIndex;
 	size_t _bufferWriteIndex;
+	bool _flushPending;
 
 	OutputSink::SharedPtr _outputSink;
 };
@@ -36,6 +36,10 @@ using Poco::Runnable;
 using Poco::Thread;
 
 
+// how long a graceful close waits between checks for open devices (in milliseconds)
+static const long DRAIN_WAIT_INTERVAL = 100;
+
+
 class OutputComponentImpl
 :
 	public OutputObserver,
@@ -145,11 +149,11 @@ void OutputComponent::close()
 			// flush buffers in output chain
 			outputSink->flush();
 
-			// wait for output sink to drain
-			while (outputSink->buffered() > 0
+			// wait for output sink to drain, checking now and then that some
+			// device is still there to drain to
+			while (!outputSink->waitUntilDrained(DRAIN_WAIT_INTERVAL)
 				&& _impl->_deviceManager.isAnyDeviceOpen())
 			{
-				Thread::yield();
 			}
 		}
 		else
@@ -360,8 +364,16 @@ void OutputComponentImpl::createOutputChain()
 	if (!(_outputFormat == _deviceManager.outputFormat()))
 	{
 		Debugger::print("Different format :(");
+
+		PCMConverter::DownmixMatrix downmixMatrix;
+		// read option then release pointer immediately
+		{
+			const Options::SharedPtr options = Options::getOptions();
+			downmixMatrix = options->getDownmixMatrix(_outputFormat.channelCount());
+		}
+
 		_outputSink = new OutputReformatter(
-			_outputFormat, _deviceManager.outputFormat(), _outputSink);
+			_outputFormat, _deviceManager.outputFormat(), _outputSink, downmixMatrix);
 
 		_formatRatio = _outputSink.cast<OutputReformatter>()->reformatRatio();
 	} else {
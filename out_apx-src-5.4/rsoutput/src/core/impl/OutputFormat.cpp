@@ -50,7 +50,7 @@ ChannelCount::ChannelCount(const int value)
 :
 	_value(value)
 {
-	assert(value >= 1 && value <= 2);
+	assert(value >= 1 && value <= 8);
 }
 
 
@@ -16,63 +16,23 @@
 
 #include "OutputReformatter.h"
 #include "Platform.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
 #include <stdexcept>
 
 
-static void ccc_mono_to_stereo(const byte_t* const in, byte_t* const out,
-	const int sampleCount, const SampleSize& sampleSize)
-{
-	// work from back to front to support in-place conversion
-	for (int s = sampleCount - 1; s >= 0; --s)
-	{
-		// duplicate channel data byte by byte
-		for (int b = sampleSize - 1; b >= 0; --b)
-		{
-			out[(s * sampleSize * 2) + b] = in[(s * sampleSize) + b];
-			out[(s * sampleSize * 2) + sampleSize + b] = in[(s * sampleSize) + b];
-		}
-	}
-}
-
-
-static void src_any_to_float_array(const byte_t* const in, float* const out,
-	const int sampleCount, const SampleSize& sampleSize)
-{
-	const int signBit = 1 << ((sampleSize * 8) - 1);
-	const float scale = 1.0F * signBit;
-
-	for (int s = 0; s < sampleCount; ++s)
-	{
-		// load sample byte by byte
-		int sample = 0;
-		for (int b = sampleSize - 1; b >= 0; --b)
-		{
-			sample = (sample << 8) | in[(s * sampleSize) + b];
-		}
+// frames drained from sample rate converter at a time at end of stream
+static const long DRAIN_FRAME_COUNT = 1024;
 
-		// extend sign bit if sample is negative
-		if (sampleSize < sizeof(int) && sample & signBit)
-		{
-			for (int b = sampleSize; b < sizeof(int); ++b)
-			{
-				sample |= 0xFF << (b * 8);
-			}
-		}
-
-		// scale sample into range [-1.0,1.0]
-		out[s] = sample / scale;
-	}
-}
-
-
-//------------------------------------------------------------------------------
+// longest the drain blocks for output sink to make room (in milliseconds)
+static const long DRAIN_WAIT_TIMEOUT = 100;
 
 
 OutputReformatter::OutputReformatter(const OutputFormat& inFormat,
-	const OutputFormat& outFormat, OutputSink::SharedPtr outputSink)
+	const OutputFormat& outFormat, OutputSink::SharedPtr outputSink,
+	const PCMConverter::DownmixMatrix& downmixMatrix)
 :
 	_inFormat(inFormat),
 	_outFormat(outFormat),
@@ -85,16 +45,25 @@ OutputReformatter::OutputReformatter(const OutputFormat& inFormat,
 			/
 		static_cast<double>(_inFormat.sampleRate())),
 	_inputFrameSize(_inFormat.sampleSize() * _inFormat.channelCount()),
-	_intermediateFrameSize(_outFormat.sampleSize() * _inFormat.channelCount()),
 	_outputFrameSize(_outFormat.sampleSize() * _outFormat.channelCount()),
+	_converter(inFormat.sampleSize(), inFormat.channelCount(), downmixMatrix),
 	_outputSink(outputSink),
-	_srcState(NULL)
+	_srcState(NULL),
+	_srcFramesIn(0),
+	_srcFramesOut(0),
+	_flushPending(false)
 {
+	if (_outFormat.sampleSize() != 2 || _outFormat.channelCount() != 2)
+	{
+		throw std::invalid_argument(
+			"_outFormat.sampleSize() != 2 || _outFormat.channelCount() != 2");
+	}
+
 	if (_inFormat.sampleRate() != _outFormat.sampleRate())
 	{
-		// initialize sample rate converter
+		// initialize sample rate converter; it runs after any downmix
 		int error = 0;
-		_srcState = src_new(SRC_SINC_MEDIUM_QUALITY, _inFormat.channelCount(), &error);
+		_srcState = src_new(SRC_SINC_POLYPHASE, _converter.floatChannelCount(), &error);
 		if (_srcState == NULL)
 		{
 			throw std::runtime_error(src_strerror(error));
@@ -119,9 +88,9 @@ time_t OutputReformatter::latency(const OutputFormat& format) const
 		throw std::logic_error("format != _inFormat");
 	}
 
-	const time_t latency = static_cast<time_t>(
-		static_cast<double>(_outputSink->latency(_outFormat)) * _resampleRatio);
-	// TODO: Add in some latency for reformatter?
+	// add time of input held back by sample rate converter's filter
+	const time_t latency = _outputSink->latency(_outFormat) + static_cast<time_t>(
+		(resamplerDelay() * 1000.0) / static_cast<double>(_inFormat.sampleRate()));
 
 	return latency;
 }
@@ -129,8 +98,11 @@ time_t OutputReformatter::latency(const OutputFormat& format) const
 
 size_t OutputReformatter::buffered() const
 {
+	// output sink counts its bytes in output format, so scale them back to
+	// input format before adding input held by sample rate converter
 	const size_t buffered = static_cast<size_t>(
-		static_cast<double>(_outputSink->buffered()) * _reformatRatio);
+		static_cast<double>(_outputSink->buffered()) / _reformatRatio
+			+ resamplerDelay() * static_cast<double>(_inputFrameSize));
 
 	return buffered;
 }
@@ -150,163 +122,129 @@ size_t OutputReformatter::canWrite() const
 
 void OutputReformatter::write(const byte_t* const buffer, const size_t length)
 {
-	if (length > canWrite() || length % _inFormat.sampleSize() != 0)
+	if (length > canWrite() || length % _inputFrameSize != 0)
 	{
 		throw std::invalid_argument(
-			"length > canWrite() || length % _inFormat.sampleSize() != 0");
+			"length > canWrite() || length % _inputFrameSize != 0");
 	}
 
-	// calculate maximum possible number of reformatted output bytes
-	size_t maxOutputLength = static_cast<size_t>(
-		std::ceil(static_cast<double>(length) * _reformatRatio));
-	// adjust value to an integral number of samples per channel
-	size_t remainder = maxOutputLength % _outputFrameSize;
-	if (remainder > 0)
-		maxOutputLength += (_outputFrameSize - remainder);
-	assert(maxOutputLength % _outputFrameSize == 0);
-
-	// resize buffer if necessary to accommodate reformatted output
-	if (_outputBuffer.size() < maxOutputLength)
-		_outputBuffer.resize(maxOutputLength);
+	_flushPending = false;
 
-	const unsigned int inputSampleCount = (length / _inFormat.sampleSize());
-	unsigned int outputSampleCount = inputSampleCount;
+	const size_t inputFrameCount = (length / _inputFrameSize);
+	size_t outputFrameCount = inputFrameCount;
 
-	if (_inFormat.sampleRate() != _outFormat.sampleRate()
-		|| _inFormat.sampleSize() != _outFormat.sampleSize())
+	if (_srcState == NULL)
 	{
-		// resize buffer if necessary to accommodate input samples
-		if (_inputBuffer.size() < inputSampleCount)
-			_inputBuffer.resize(inputSampleCount);
-
-		// convert samples to floating-point format
-		src_any_to_float_array(
-			buffer, &_inputBuffer[0], inputSampleCount, _inFormat.sampleSize());
+		// resize buffer if necessary to accommodate reformatted output
+		if (_outputBuffer.size() < outputFrameCount * _outputFrameSize)
+			_outputBuffer.resize(outputFrameCount * _outputFrameSize);
 
-		const float* sampleBuffer;
-
-		if (_inFormat.sampleRate() != _outFormat.sampleRate())
+		// sample rate is unchanged, so convert sample size and channel count
+		// in a single pass without going through floating-point format
+		_converter.toStereo16(buffer, &_outputBuffer[0], inputFrameCount);
+	}
+	else
+	{
+		const size_t channelCount = _converter.floatChannelCount();
+
+		// resize buffer if necessary to accommodate input samples; it is kept
+		// from being empty so that an empty write has somewhere to point
+		if (_inputBuffer.size() <= inputFrameCount * channelCount)
+			_inputBuffer.resize(inputFrameCount * channelCount + 1);
+
+		// convert samples to floating-point format, downmixing to stereo
+		// beforehand if there are more than two channels
+		_converter.toFloat(buffer, &_inputBuffer[0], inputFrameCount);
+
+		// calculate maximum possible number of generated frames
+		outputFrameCount = static_cast<size_t>(
+			std::ceil(static_cast<double>(inputFrameCount) * _resampleRatio));
+
+		// resize buffer if necessary to accommodate output samples
+		if (_intermediateBuffer.size() <= outputFrameCount * channelCount)
+			_intermediateBuffer.resize(outputFrameCount * channelCount + 1);
+
+		// prepare for sample rate conversion
+		SRC_DATA srcData;
+		std::memset(&srcData, 0, sizeof(SRC_DATA));
+		srcData.data_in = &_inputBuffer[0];
+		srcData.data_out = &_intermediateBuffer[0];
+		srcData.input_frames = inputFrameCount;
+		srcData.output_frames = outputFrameCount;
+		srcData.src_ratio = _resampleRatio;
+
+		// resample input data at output sample rate
+		const int returnCode = src_process(_srcState, &srcData);
+		if (returnCode != 0)
 		{
-			// calculate maximum possible number of generated samples
-			outputSampleCount = static_cast<unsigned int>(
-				std::ceil(static_cast<double>(outputSampleCount) * _resampleRatio));
-			// adjust value to an integral number of samples per channel
-			remainder = outputSampleCount % _intermediateFrameSize;
-			if (remainder > 0)
-				outputSampleCount += (_intermediateFrameSize - remainder);
-			assert(outputSampleCount % _intermediateFrameSize == 0);
-
-			// resize buffer if necessary to accommodate output samples
-			if (_intermediateBuffer.size() < outputSampleCount)
-				_intermediateBuffer.resize(outputSampleCount);
-
-			// prepare for sample rate conversion
-			SRC_DATA srcData;
-			std::memset(&srcData, 0, sizeof(SRC_DATA));
-			srcData.data_in = &_inputBuffer[0];
-			srcData.data_out = &_intermediateBuffer[0];
-			srcData.input_frames = inputSampleCount / _inFormat.channelCount();
-			srcData.output_frames = outputSampleCount / _inFormat.channelCount();
-			srcData.src_ratio = _resampleRatio;
-
-			if (length == 0)
-			{
-				// indicate there is no more input so sample rate converter will
-				// not maintain any carryover state after next call
-				srcData.end_of_input = 1;
-			}
-
-			assert(_srcState != NULL);
-
-			// resample input data at output sample rate
-			const int returnCode = src_process(_srcState, &srcData);
-			if (returnCode != 0)
-			{
-				throw std::runtime_error(src_strerror(returnCode));
-			}
-
-			assert(srcData.input_frames_used == srcData.input_frames);
-
-			outputSampleCount = srcData.output_frames_gen * _inFormat.channelCount();
+			throw std::runtime_error(src_strerror(returnCode));
+		}
 
-			// check for buffer overflow
-			assert(_intermediateBuffer.size() >= outputSampleCount);
+		assert(srcData.input_frames_used == srcData.input_frames);
 
-			sampleBuffer = &_intermediateBuffer[0];
-		}
-		else
-		{
-			sampleBuffer = &_inputBuffer[0];
-		}
+		outputFrameCount = srcData.output_frames_gen;
 
-		// check for buffer overflow
-		assert(_outputBuffer.size() >= outputSampleCount * _outFormat.sampleSize());
+		_srcFramesIn += srcData.input_frames_used;
+		_srcFramesOut += srcData.output_frames_gen;
 
-		// use of src_float_to_short_array() assumes out sample size of 2
-		assert(_outFormat.sampleSize() == 2);
+		// resize buffer if necessary to accommodate reformatted output
+		if (_outputBuffer.size() < outputFrameCount * _outputFrameSize)
+			_outputBuffer.resize(outputFrameCount * _outputFrameSize);
 
-		// convert samples to integer format
-		src_float_to_short_array(
-			sampleBuffer, reinterpret_cast<short*>(&_outputBuffer[0]), outputSampleCount);
+		// convert samples to 16-bit stereo in a single pass
+		_converter.floatToStereo16(&_intermediateBuffer[0], &_outputBuffer[0], outputFrameCount);
 	}
 
-	// write may have been called with no input to flush sample rate converter;
 	// check if nothing remains to be written
-	if (outputSampleCount < 1)
+	if (outputFrameCount < 1)
 	{
 		return;
 	}
 
-	if (_inFormat.channelCount() != _outFormat.channelCount())
-	{
-		const byte_t* sampleBuffer;
-
-		if (_inFormat.sampleRate() != _outFormat.sampleRate()
-			|| _inFormat.sampleSize() != _outFormat.sampleSize())
-		{
-			// if sample rate and/or size conversion was done, output buffer
-			// contains the sample data
-			sampleBuffer = &_outputBuffer[0];
-		}
-		else
-		{
-			// otherwise use input buffer sample data
-			sampleBuffer = buffer;
-		}
+	_outputSink->write(&_outputBuffer[0], outputFrameCount * _outputFrameSize);
+}
 
-		// check for buffer overflow
-		assert(_outputBuffer.size() >=
-			outputSampleCount * _outFormat.sampleSize() * _outFormat.channelCount());
 
-		// use of ccc_mono_to_stereo() assumes in channel count of 1 and out channel count of 2
-		assert(_inFormat.channelCount() == 1 && _outFormat.channelCount() == 2);
+void OutputReformatter::flush()
+{
+	// players also flush when they merely pause writing, so the sample rate
+	// converter keeps its carryover state for the input that may follow; it
+	// is drained when flushed again with nothing written in between
+	if (_srcState != NULL && _flushPending)
+	{
+		drainResampler();
+	}
+	_flushPending = true;
 
-		ccc_mono_to_stereo(
-			sampleBuffer, &_outputBuffer[0], outputSampleCount, _outFormat.sampleSize());
+	_outputSink->flush();
+}
 
-		assert(outputSampleCount % _inFormat.channelCount() == 0);
-		outputSampleCount /= _inFormat.channelCount();
-		outputSampleCount *= _outFormat.channelCount();
-	}
 
-	_outputSink->write(&_outputBuffer[0], outputSampleCount * _outFormat.sampleSize());
+bool OutputReformatter::waitForSpace(const long milliseconds)
+{
+	return _outputSink->waitForSpace(milliseconds);
 }
 
 
-void OutputReformatter::flush()
+bool OutputReformatter::waitUntilDrained(const long milliseconds)
 {
-	if (_srcState != NULL)
+	// waiting for output to drain after a flush means no more input follows,
+	// so put out what the sample rate converter still holds ahead of it
+	if (_srcState != NULL && _flushPending)
 	{
-		// flush sample rate converter with an empty write
-		write(NULL, 0);
+		drainResampler();
+		_flushPending = false;
 	}
 
-	_outputSink->flush();
+	return _outputSink->waitUntilDrained(milliseconds);
 }
 
 
 void OutputReformatter::reset()
 {
+	_converter.reset();
+	_flushPending = false;
+
 	if (_srcState != NULL)
 	{
 		// reset state of sample rate converter
@@ -315,7 +253,87 @@ void OutputReformatter::reset()
 		{
 			assert(returnCode == 0);
 		}
+
+		_srcFramesIn = _srcFramesOut = 0;
 	}
 
 	_outputSink->reset();
 }
+
+
+//------------------------------------------------------------------------------
+
+
+double OutputReformatter::resamplerDelay() const
+{
+	// whatever input has not come out yet is still in the converter's filter
+	const double delay = static_cast<double>(_srcFramesIn)
+		- static_cast<double>(_srcFramesOut) / _resampleRatio;
+
+	return std::max(delay, 0.0);
+}
+
+
+void OutputReformatter::drainResampler()
+{
+	const size_t channelCount = _converter.floatChannelCount();
+
+	if (_inputBuffer.empty())
+		_inputBuffer.resize(1);
+	if (_intermediateBuffer.size() < DRAIN_FRAME_COUNT * channelCount)
+		_intermediateBuffer.resize(DRAIN_FRAME_COUNT * channelCount);
+	if (_outputBuffer.size() < DRAIN_FRAME_COUNT * _outputFrameSize)
+		_outputBuffer.resize(DRAIN_FRAME_COUNT * _outputFrameSize);
+
+	for (;;)
+	{
+		// indicate there is no more input so sample rate converter puts out
+		// what its filter holds
+		SRC_DATA srcData;
+		std::memset(&srcData, 0, sizeof(SRC_DATA));
+		srcData.data_in = &_inputBuffer[0];
+		srcData.data_out = &_intermediateBuffer[0];
+		srcData.output_frames = DRAIN_FRAME_COUNT;
+		srcData.end_of_input = 1;
+		srcData.src_ratio = _resampleRatio;
+
+		const int returnCode = src_process(_srcState, &srcData);
+		if (returnCode != 0)
+		{
+			throw std::runtime_error(src_strerror(returnCode));
+		}
+		if (srcData.output_frames_gen < 1)
+		{
+			break;
+		}
+
+		_converter.floatToStereo16(&_intermediateBuffer[0], &_outputBuffer[0], srcData.output_frames_gen);
+
+		// write as output sink makes room, giving up on the tail if it stalls
+		const byte_t* data = &_outputBuffer[0];
+		size_t remaining = srcData.output_frames_gen * _outputFrameSize;
+		while (remaining > 0)
+		{
+			if (_outputSink->canWrite() == 0
+				&& !_outputSink->waitForSpace(DRAIN_WAIT_TIMEOUT))
+			{
+				break;
+			}
+
+			size_t length = std::min(remaining, _outputSink->canWrite());
+			length -= (length % _outputFrameSize);
+			if (length == 0)
+			{
+				break;
+			}
+
+			_outputSink->write(data, length);
+			data += length;
+			remaining -= length;
+		}
+	}
+
+	// start over for any stream that follows
+	src_reset(_srcState);
+	_srcFramesIn = _srcFramesOut = 0;
+}
@@ -20,6 +20,7 @@
 
 #include "OutputFormat.h"
 #include "OutputSink.h"
+#include "PCMConverter.h"
 #include "Platform.h"
 #include "Uncopyable.h"
 #include <vector>
@@ -33,7 +34,8 @@ class OutputReformatter
 {
 public:
 	OutputReformatter(const OutputFormat& incoming, const OutputFormat& outgoing,
-		OutputSink::SharedPtr);
+		OutputSink::SharedPtr,
+		const PCMConverter::DownmixMatrix& = PCMConverter::DownmixMatrix());
 	~OutputReformatter();
 
 	double reformatRatio() const;
@@ -47,6 +49,9 @@ public:
 	void flush();
 	void reset();
 
+	bool waitForSpace(long milliseconds);
+	bool waitUntilDrained(long milliseconds);
+
 private:
 	const OutputFormat _inFormat;
 	const OutputFormat _outFormat;
@@ -55,9 +60,10 @@ private:
 	const double _resampleRatio;
 
 	const size_t _inputFrameSize;
-	const size_t _intermediateFrameSize;
 	const size_t _outputFrameSize;
 
+	PCMConverter _converter;
+
 	std::vector<float> _inputBuffer;
 	std::vector<float> _intermediateBuffer;
 	std::vector<byte_t> _outputBuffer;
@@ -65,6 +71,14 @@ private:
 	OutputSink::SharedPtr _outputSink;
 
 	SRC_STATE* _srcState;
+
+	/** frames into and out of sample rate converter since reset */
+	uint64_t _srcFramesIn;
+	uint64_t _srcFramesOut;
+	bool _flushPending;
+
+	double resamplerDelay() const; // in input frames
+	void drainResampler();
 };
 
 
@@ -37,6 +37,11 @@ public:
 	virtual void write(const byte_t*, size_t) = 0;
 	virtual void flush() = 0;
 	virtual void reset() = 0;
+
+	// block until canWrite() is nonzero, returning false on timeout
+	virtual bool waitForSpace(long milliseconds) = 0;
+	// block until everything written has been sent, returning false on timeout
+	virtual bool waitUntilDrained(long milliseconds) = 0;
 };
 
 
@@ -0,0 +1,699 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PCMConverter.h"
+#include "Platform.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+
+// SSE2 is part of every x64 target and of the x86 target by default, so the
+// vector kernels need no processor check of their own
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#	define PCM_SSE2 1
+#	include <emmintrin.h>
+#else
+#	define PCM_SSE2 0
+#endif
+
+
+// load one little-endian sample, extending its sign to 32 bits
+template <int SIZE> static inline int32_t loadSample(const byte_t*);
+
+template <> inline int32_t loadSample<1>(const byte_t* const in)
+{
+	return static_cast<int8_t>(in[0]);
+}
+
+template <> inline int32_t loadSample<2>(const byte_t* const in)
+{
+	return static_cast<int16_t>(in[0] | (in[1] << 8));
+}
+
+template <> inline int32_t loadSample<3>(const byte_t* const in)
+{
+	return static_cast<int32_t>((uint32_t(in[0]) << 8)
+		| (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 24)) >> 8;
+}
+
+template <> inline int32_t loadSample<4>(const byte_t* const in)
+{
+	return static_cast<int32_t>(uint32_t(in[0])
+		| (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24));
+}
+
+
+static inline uint32_t nextDither(uint32_t& state)
+{
+	// xorshift generator; cheap enough to run once per sample
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+
+static inline int16_t ditherTo16(const int32_t sample24, uint32_t& state)
+{
+	// two uniform values of one output step each sum to triangular dither;
+	// the extra half step makes the shift round to nearest
+	const uint32_t random = nextDither(state);
+	const int32_t dither = int32_t(random & 0xFF) + int32_t((random >> 8) & 0xFF) - 127;
+	const int32_t sample = (sample24 + dither) >> 8;
+
+	return static_cast<int16_t>(sample < -32768 ? -32768 : (sample > 32767 ? 32767 : sample));
+}
+
+
+// load one sample and reduce or widen it to 16 bits
+template <int SIZE> static inline int16_t toSample16(const byte_t*, uint32_t&);
+
+template <> inline int16_t toSample16<1>(const byte_t* const in, uint32_t&)
+{
+	return static_cast<int16_t>(loadSample<1>(in) * 256);
+}
+
+template <> inline int16_t toSample16<2>(const byte_t* const in, uint32_t&)
+{
+	return static_cast<int16_t>(loadSample<2>(in));
+}
+
+template <> inline int16_t toSample16<3>(const byte_t* const in, uint32_t& state)
+{
+	return ditherTo16(loadSample<3>(in), state);
+}
+
+template <> inline int16_t toSample16<4>(const byte_t* const in, uint32_t& state)
+{
+	return ditherTo16(loadSample<4>(in) >> 8, state);
+}
+
+
+static inline int16_t floatToSample16(const float value)
+{
+	// same scaling, rounding and clipping as src_float_to_short_array
+	const double scaled = value * (8.0 * 0x10000000);
+	if (scaled >= (1.0 * 0x7FFFFFFF))
+	{
+		return 32767;
+	}
+	if (scaled <= (-8.0 * 0x10000000))
+	{
+		return -32768;
+	}
+	return static_cast<int16_t>(std::lrint(scaled) >> 16);
+}
+
+
+// store one sample of the given channel count as one or both of a stereo pair
+template <int CHANNELS> static inline void storeSample16(int16_t*, size_t, int16_t);
+
+template <> inline void storeSample16<1>(int16_t* const out, const size_t s, const int16_t sample)
+{
+	out[(s * 2)] = sample;
+	out[(s * 2) + 1] = sample;
+}
+
+template <> inline void storeSample16<2>(int16_t* const out, const size_t s, const int16_t sample)
+{
+	out[s] = sample;
+}
+
+
+//------------------------------------------------------------------------------
+// scalar kernels; sample s always draws dither from lane s % 4, which the vector
+// kernels follow too so that both produce the same output
+
+
+template <int SIZE, int CHANNELS>
+static void toStereo16Scalar(const byte_t* const in, int16_t* const out,
+	const size_t frameCount, uint32_t* const ditherState)
+{
+	const size_t sampleCount = frameCount * CHANNELS;
+
+	for (size_t s = 0; s < sampleCount; ++s)
+	{
+		storeSample16<CHANNELS>(out, s, toSample16<SIZE>(&in[s * SIZE], ditherState[s & 3]));
+	}
+}
+
+
+template <int SIZE>
+static void toFloatScalar(const byte_t* const in, float* const out, const size_t sampleCount)
+{
+	const float scale = 1.0F / static_cast<float>(1U << ((SIZE * 8) - 1));
+
+	for (size_t s = 0; s < sampleCount; ++s)
+	{
+		out[s] = static_cast<float>(loadSample<SIZE>(&in[s * SIZE])) * scale;
+	}
+}
+
+
+template <int CHANNELS>
+static void floatToStereo16Scalar(const float* const in, int16_t* const out, const size_t frameCount)
+{
+	const size_t sampleCount = frameCount * CHANNELS;
+
+	for (size_t s = 0; s < sampleCount; ++s)
+	{
+		storeSample16<CHANNELS>(out, s, floatToSample16(in[s]));
+	}
+}
+
+
+// even and odd channels are summed apart and then together, which is the order
+// the vector kernel adds them in
+template <int CHANNELS>
+static void downmixScalar(const float* const in, float* const out,
+	const size_t frameCount, const float* const coefficients)
+{
+	for (size_t f = 0; f < frameCount; ++f)
+	{
+		const float* const frame = &in[f * CHANNELS];
+		float left[2] = { 0.0F, 0.0F };
+		float right[2] = { 0.0F, 0.0F };
+
+		for (int c = 0; c < CHANNELS; ++c)
+		{
+			left[c & 1] += frame[c] * coefficients[(c * 2)];
+			right[c & 1] += frame[c] * coefficients[(c * 2) + 1];
+		}
+
+		out[(f * 2)] = left[0] + left[1];
+		out[(f * 2) + 1] = right[0] + right[1];
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// SSE2 kernels; each converts whole vectors and leaves any tail to its scalar
+// counterpart, which is a whole number of frames because vectors cover an even
+// number of samples
+
+
+#if PCM_SSE2
+
+// store eight 16-bit samples of the given channel count as stereo frames
+template <int CHANNELS> static inline void storeVector16(int16_t*, __m128i);
+
+template <> inline void storeVector16<1>(int16_t* const out, const __m128i samples)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(samples, samples));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi16(samples, samples));
+}
+
+template <> inline void storeVector16<2>(int16_t* const out, const __m128i samples)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), samples);
+}
+
+
+// store four 16-bit samples (the low half of the vector) as stereo frames
+template <int CHANNELS> static inline void storeHalfVector16(int16_t*, __m128i);
+
+template <> inline void storeHalfVector16<1>(int16_t* const out, const __m128i samples)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(samples, samples));
+}
+
+template <> inline void storeHalfVector16<2>(int16_t* const out, const __m128i samples)
+{
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(out), samples);
+}
+
+
+// load four samples as sign-extended 32-bit values; the 24-bit load reads
+// 16 bytes, so callers must leave four bytes past the last sample readable
+template <int SIZE> static inline __m128i loadVector32(const byte_t*);
+
+template <> inline __m128i loadVector32<3>(const byte_t* const in)
+{
+	const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+
+	// bring each sample to the bottom of its own lane
+	const __m128i s01 = _mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3));
+	const __m128i s23 = _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6), _mm_srli_si128(bytes, 9));
+	const __m128i samples = _mm_unpacklo_epi64(s01, s23);
+
+	return _mm_srai_epi32(_mm_slli_epi32(samples, 8), 8);
+}
+
+template <> inline __m128i loadVector32<4>(const byte_t* const in)
+{
+	return _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+}
+
+
+static inline __m128i nextDither(__m128i& state)
+{
+	state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+	state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+	state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i sum = _mm_add_epi32(
+		_mm_and_si128(state, mask), _mm_and_si128(_mm_srli_epi32(state, 8), mask));
+
+	return _mm_sub_epi32(sum, _mm_set1_epi32(127));
+}
+
+
+// 8-bit samples are widened by placing each byte above a zero byte
+template <int SIZE, int CHANNELS>
+static void toStereo16Widen(const byte_t* const in, int16_t* const out,
+	const size_t frameCount, uint32_t* const ditherState)
+{
+	const size_t sampleCount = frameCount * CHANNELS;
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t s = 0;
+	for (; s + 16 <= sampleCount; s += 16)
+	{
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[s]));
+		storeVector16<CHANNELS>(&out[s * 2 / CHANNELS], _mm_unpacklo_epi8(zero, bytes));
+		storeVector16<CHANNELS>(&out[(s + 8) * 2 / CHANNELS], _mm_unpackhi_epi8(zero, bytes));
+	}
+
+	toStereo16Scalar<SIZE, CHANNELS>(&in[s], &out[s * 2 / CHANNELS],
+		(sampleCount - s) / CHANNELS, ditherState);
+}
+
+
+// 16-bit samples only need mono duplicated into stereo
+template <int SIZE, int CHANNELS>
+static void toStereo16Copy(const byte_t* const in, int16_t* const out,
+	const size_t frameCount, uint32_t* const ditherState)
+{
+	const size_t sampleCount = frameCount * CHANNELS;
+
+	size_t s = 0;
+	for (; s + 8 <= sampleCount; s += 8)
+	{
+		storeVector16<CHANNELS>(&out[s * 2 / CHANNELS],
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[s * 2])));
+	}
+
+	toStereo16Scalar<SIZE, CHANNELS>(&in[s * 2], &out[s * 2 / CHANNELS],
+		(sampleCount - s) / CHANNELS, ditherState);
+}
+
+
+// 24- and 32-bit samples are brought to 24 bits, dithered and narrowed
+template <int SIZE, int CHANNELS>
+static void toStereo16Dither(const byte_t* const in, int16_t* const out,
+	const size_t frameCount, uint32_t* const ditherState)
+{
+	const size_t sampleCount = frameCount * CHANNELS;
+	__m128i state = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ditherState));
+
+	size_t s = 0;
+	for (; (s * SIZE) + 16 <= (sampleCount * SIZE); s += 4)
+	{
+		__m128i samples = loadVector32<SIZE>(&in[s * SIZE]);
+		if (SIZE == 4)
+		{
+			samples = _mm_srai_epi32(samples, 8);
+		}
+
+		samples = _mm_srai_epi32(_mm_add_epi32(samples, nextDither(state)), 8);
+		storeHalfVector16<CHANNELS>(&out[s * 2 / CHANNELS], _mm_packs_epi32(samples, samples));
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(ditherState), state);
+
+	// vectors always cover a multiple of four samples, so the tail starts at lane 0
+	toStereo16Scalar<SIZE, CHANNELS>(&in[s * SIZE], &out[s * 2 / CHANNELS],
+		(sampleCount - s) / CHANNELS, ditherState);
+}
+
+
+template <int SIZE>
+static void toFloatVector(const byte_t* const in, float* const out, const size_t sampleCount)
+{
+	const __m128 scale = _mm_set1_ps(1.0F / static_cast<float>(1U << ((SIZE * 8) - 1)));
+
+	size_t s = 0;
+	if (SIZE == 1)
+	{
+		for (; s + 16 <= sampleCount; s += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[s]));
+			const __m128i lo = _mm_unpacklo_epi8(bytes, bytes);
+			const __m128i hi = _mm_unpackhi_epi8(bytes, bytes);
+
+			_mm_storeu_ps(&out[s], _mm_mul_ps(scale, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24))));
+			_mm_storeu_ps(&out[s + 4], _mm_mul_ps(scale, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24))));
+			_mm_storeu_ps(&out[s + 8], _mm_mul_ps(scale, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24))));
+			_mm_storeu_ps(&out[s + 12], _mm_mul_ps(scale, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24))));
+		}
+	}
+	else if (SIZE == 2)
+	{
+		for (; s + 8 <= sampleCount; s += 8)
+		{
+			const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[s * 2]));
+
+			_mm_storeu_ps(&out[s], _mm_mul_ps(scale, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16))));
+			_mm_storeu_ps(&out[s + 4], _mm_mul_ps(scale, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16))));
+		}
+	}
+	else
+	{
+		for (; (s * SIZE) + 16 <= (sampleCount * SIZE); s += 4)
+		{
+			_mm_storeu_ps(&out[s], _mm_mul_ps(scale,
+				_mm_cvtepi32_ps(loadVector32<(SIZE > 2 ? SIZE : 4)>(&in[s * SIZE]))));
+		}
+	}
+
+	toFloatScalar<SIZE>(&in[s * SIZE], &out[s], sampleCount - s);
+}
+
+
+template <int CHANNELS>
+static void floatToStereo16Vector(const float* const in, int16_t* const out, const size_t frameCount)
+{
+	const size_t sampleCount = frameCount * CHANNELS;
+
+	// scale to 32 bits as src_float_to_short_array does, keeping values where
+	// conversion saturates correctly, then keep the top 16 bits
+	const __m128 scale = _mm_set1_ps(8.0F * 0x10000000);
+	const __m128 upper = _mm_set1_ps(2147483520.0F); // largest float below 2^31
+	const __m128 lower = _mm_set1_ps(-2147483648.0F);
+
+	size_t s = 0;
+	for (; s + 8 <= sampleCount; s += 8)
+	{
+		const __m128 lo = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(&in[s]), scale), upper), lower);
+		const __m128 hi = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(&in[s + 4]), scale), upper), lower);
+
+		storeVector16<CHANNELS>(&out[s * 2 / CHANNELS], _mm_packs_epi32(
+			_mm_srai_epi32(_mm_cvtps_epi32(lo), 16),
+			_mm_srai_epi32(_mm_cvtps_epi32(hi), 16)));
+	}
+
+	floatToStereo16Scalar<CHANNELS>(&in[s], &out[s * 2 / CHANNELS], (sampleCount - s) / CHANNELS);
+}
+
+
+// each pair of channels is duplicated across a vector, multiplied by the left
+// and right coefficients of both and accumulated; halves are added at the end
+template <int CHANNELS>
+static void downmixVector(const float* const in, float* const out,
+	const size_t frameCount, const float* const coefficients)
+{
+	__m128 pairCoefficients[(CHANNELS + 1) / 2];
+	for (int p = 0; p < (CHANNELS + 1) / 2; ++p)
+	{
+		pairCoefficients[p] = _mm_loadu_ps(&coefficients[p * 4]);
+	}
+
+	for (size_t f = 0; f < frameCount; ++f)
+	{
+		const float* const frame = &in[f * CHANNELS];
+		__m128 sum = _mm_setzero_ps();
+
+		for (int p = 0; p < CHANNELS / 2; ++p)
+		{
+			const __m128 pair = _mm_castsi128_ps(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&frame[p * 2])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_unpacklo_ps(pair, pair), pairCoefficients[p]));
+		}
+		if (CHANNELS % 2 != 0)
+		{
+			const __m128 last = _mm_load_ss(&frame[CHANNELS - 1]);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_unpacklo_ps(last, last), pairCoefficients[CHANNELS / 2]));
+		}
+
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		_mm_storel_pi(reinterpret_cast<__m64*>(&out[f * 2]), sum);
+	}
+}
+
+#endif // PCM_SSE2
+
+
+//------------------------------------------------------------------------------
+
+
+// frames downmixed at a time, small enough for the intermediate samples to
+// stay in cache between conversion steps
+static const size_t DOWNMIX_BLOCK_FRAMES = 256;
+
+
+PCMConverter::DownmixMatrix PCMConverter::defaultDownmixMatrix(const ChannelCount& channelCount)
+{
+	enum Speaker { FL, FR, FC, LFE, BL, BR, BC, SL, SR };
+
+	// ITU-R BS.775 weights: centre and surrounds at -3 dB, back centre split
+	// between both surrounds, low-frequency effects left out
+	static const float a = 0.70710678F;
+	static const float weights[][2] =
+	{
+		{ 1.0F, 0.0F }, { 0.0F, 1.0F }, { a, a }, { 0.0F, 0.0F },
+		{ a, 0.0F }, { 0.0F, a }, { a * a, a * a }, { a, 0.0F }, { 0.0F, a },
+	};
+
+	// speaker positions for three to eight channels, in WAVE/FLAC order
+	static const Speaker layouts[6][8] =
+	{
+		{ FL, FR, FC },
+		{ FL, FR, BL, BR },
+		{ FL, FR, FC, BL, BR },
+		{ FL, FR, FC, LFE, BL, BR },
+		{ FL, FR, FC, LFE, BC, SL, SR },
+		{ FL, FR, FC, LFE, BL, BR, SL, SR },
+	};
+
+	if (channelCount < 3)
+	{
+		return DownmixMatrix();
+	}
+
+	DownmixMatrix matrix(channelCount * 2);
+	float sum = 0.0F;
+	for (int c = 0; c < channelCount; ++c)
+	{
+		const Speaker speaker = layouts[channelCount - 3][c];
+		matrix[c] = weights[speaker][0];
+		matrix[channelCount + c] = weights[speaker][1];
+		sum += weights[speaker][0];
+	}
+
+	// scale so that a full-scale signal on every channel does not clip
+	for (size_t i = 0; i < matrix.size(); ++i)
+	{
+		matrix[i] /= sum;
+	}
+
+	return matrix;
+}
+
+
+PCMConverter::PCMConverter(const SampleSize& sampleSize,
+	const ChannelCount& channelCount, const DownmixMatrix& downmixMatrix,
+	const bool vectorize)
+:
+	_toStereo16(NULL),
+	_downmix(NULL),
+	_sampleSize(sampleSize),
+	_channelCount(channelCount)
+{
+	if (channelCount < 1 || channelCount > 8)
+	{
+		throw std::invalid_argument("channelCount < 1 || channelCount > 8");
+	}
+
+	// indexed by sample size and channel count less one
+	static const IntegerKernel toStereo16Kernels[2][4][2] =
+	{
+		{
+			{ &toStereo16Scalar<1,1>, &toStereo16Scalar<1,2> },
+			{ &toStereo16Scalar<2,1>, &toStereo16Scalar<2,2> },
+			{ &toStereo16Scalar<3,1>, &toStereo16Scalar<3,2> },
+			{ &toStereo16Scalar<4,1>, &toStereo16Scalar<4,2> },
+		},
+#if PCM_SSE2
+		{
+			{ &toStereo16Widen<1,1>, &toStereo16Widen<1,2> },
+			{ &toStereo16Copy<2,1>, &toStereo16Copy<2,2> },
+			{ &toStereo16Dither<3,1>, &toStereo16Dither<3,2> },
+			{ &toStereo16Dither<4,1>, &toStereo16Dither<4,2> },
+		},
+#else
+		{
+			{ &toStereo16Scalar<1,1>, &toStereo16Scalar<1,2> },
+			{ &toStereo16Scalar<2,1>, &toStereo16Scalar<2,2> },
+			{ &toStereo16Scalar<3,1>, &toStereo16Scalar<3,2> },
+			{ &toStereo16Scalar<4,1>, &toStereo16Scalar<4,2> },
+		},
+#endif
+	};
+
+	static const FloatInKernel toFloatKernels[2][4] =
+	{
+		{ &toFloatScalar<1>, &toFloatScalar<2>, &toFloatScalar<3>, &toFloatScalar<4> },
+#if PCM_SSE2
+		{ &toFloatVector<1>, &toFloatVector<2>, &toFloatVector<3>, &toFloatVector<4> },
+#else
+		{ &toFloatScalar<1>, &toFloatScalar<2>, &toFloatScalar<3>, &toFloatScalar<4> },
+#endif
+	};
+
+	static const FloatOutKernel floatToStereo16Kernels[2][2] =
+	{
+		{ &floatToStereo16Scalar<1>, &floatToStereo16Scalar<2> },
+#if PCM_SSE2
+		{ &floatToStereo16Vector<1>, &floatToStereo16Vector<2> },
+#else
+		{ &floatToStereo16Scalar<1>, &floatToStereo16Scalar<2> },
+#endif
+	};
+
+	// indexed by channel count less three
+	static const DownmixKernel downmixKernels[2][6] =
+	{
+		{
+			&downmixScalar<3>, &downmixScalar<4>, &downmixScalar<5>,
+			&downmixScalar<6>, &downmixScalar<7>, &downmixScalar<8>,
+		},
+#if PCM_SSE2
+		{
+			&downmixVector<3>, &downmixVector<4>, &downmixVector<5>,
+			&downmixVector<6>, &downmixVector<7>, &downmixVector<8>,
+		},
+#else
+		{
+			&downmixScalar<3>, &downmixScalar<4>, &downmixScalar<5>,
+			&downmixScalar<6>, &downmixScalar<7>, &downmixScalar<8>,
+		},
+#endif
+	};
+
+	const int v = (vectorize ? 1 : 0);
+	_toFloat = toFloatKernels[v][sampleSize - 1];
+	_floatToStereo16 = floatToStereo16Kernels[v][floatChannelCount() - 1];
+
+	std::fill(_downmixCoefficients, _downmixCoefficients + 16, 0.0F);
+
+	if (channelCount <= 2)
+	{
+		_toStereo16 = toStereo16Kernels[v][sampleSize - 1][channelCount - 1];
+	}
+	else
+	{
+		const DownmixMatrix matrix(downmixMatrix.empty()
+			? defaultDownmixMatrix(channelCount) : downmixMatrix);
+		if (matrix.size() != _channelCount * 2)
+		{
+			throw std::invalid_argument("downmixMatrix.size() != channelCount * 2");
+		}
+
+		// interleave rows so that each channel's coefficients are adjacent
+		for (size_t c = 0; c < _channelCount; ++c)
+		{
+			_downmixCoefficients[(c * 2)] = matrix[c];
+			_downmixCoefficients[(c * 2) + 1] = matrix[_channelCount + c];
+		}
+
+		_downmix = downmixKernels[v][channelCount - 3];
+		_downmixBuffer.resize(DOWNMIX_BLOCK_FRAMES * (_channelCount + 2));
+	}
+
+	reset();
+}
+
+
+ChannelCount PCMConverter::floatChannelCount() const
+{
+	return ChannelCount(_channelCount <= 2 ? static_cast<int>(_channelCount) : 2);
+}
+
+
+void PCMConverter::toStereo16(const byte_t* const in, byte_t* const out, const size_t frameCount)
+{
+	assert(in != NULL || frameCount == 0);
+
+	if (_downmix == NULL)
+	{
+		_toStereo16(in, reinterpret_cast<int16_t*>(out), frameCount, _ditherState);
+		return;
+	}
+
+	// downmix into the tail of the buffer, then narrow to 16 bits
+	float* const mixed = &_downmixBuffer[DOWNMIX_BLOCK_FRAMES * _channelCount];
+	for (size_t f = 0; f < frameCount; f += DOWNMIX_BLOCK_FRAMES)
+	{
+		const size_t blockFrames = std::min(frameCount - f, DOWNMIX_BLOCK_FRAMES);
+
+		toFloatStereo(&in[f * _sampleSize * _channelCount], mixed, blockFrames);
+		_floatToStereo16(mixed, reinterpret_cast<int16_t*>(&out[f * 4]), blockFrames);
+	}
+}
+
+
+void PCMConverter::toFloat(const byte_t* const in, float* const out, const size_t frameCount)
+{
+	assert(in != NULL || frameCount == 0);
+
+	if (_downmix == NULL)
+	{
+		_toFloat(in, out, frameCount * _channelCount);
+		return;
+	}
+
+	for (size_t f = 0; f < frameCount; f += DOWNMIX_BLOCK_FRAMES)
+	{
+		const size_t blockFrames = std::min(frameCount - f, DOWNMIX_BLOCK_FRAMES);
+
+		toFloatStereo(&in[f * _sampleSize * _channelCount], &out[f * 2], blockFrames);
+	}
+}
+
+
+void PCMConverter::toFloatStereo(const byte_t* const in, float* const out, const size_t frameCount)
+{
+	assert(frameCount <= DOWNMIX_BLOCK_FRAMES);
+
+	_toFloat(in, &_downmixBuffer[0], frameCount * _channelCount);
+	_downmix(&_downmixBuffer[0], out, frameCount, _downmixCoefficients);
+}
+
+
+void PCMConverter::floatToStereo16(const float* const in, byte_t* const out, const size_t frameCount) const
+{
+	assert(in != NULL || frameCount == 0);
+	_floatToStereo16(in, reinterpret_cast<int16_t*>(out), frameCount);
+}
+
+
+void PCMConverter::reset()
+{
+	// any nonzero seeds will do; distinct ones keep the lanes uncorrelated
+	_ditherState[0] = 0x9E3779B9;
+	_ditherState[1] = 0x7F4A7C15;
+	_ditherState[2] = 0x85EBCA6B;
+	_ditherState[3] = 0xC2B2AE35;
+}
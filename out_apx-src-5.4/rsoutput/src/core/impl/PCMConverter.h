@@ -0,0 +1,90 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PCMConverter_h
+#define PCMConverter_h
+
+
+#include "OutputFormat.h"
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <vector>
+
+
+/**
+ * Converts interleaved little-endian signed PCM samples of one size and
+ * channel count to the 16-bit stereo that the output devices take.  Kernels
+ * are specialized for each sample size and channel count and picked once on
+ * construction, so conversions do a single pass without per-sample branches.
+ *
+ * When only sample size or channel count changes, toStereo16() converts
+ * directly; samples wider than 16 bits are reduced with TPDF dither.  When
+ * sample rate changes too, toFloat() and floatToStereo16() bracket the
+ * resampler, the latter rounding and clipping as src_float_to_short_array().
+ *
+ * Three to eight channels are downmixed to stereo by a matrix as they are
+ * converted to floating-point format, so the resampler only sees two.  The
+ * matrix holds a row of left then a row of right coefficients, one for each
+ * channel in WAVE/FLAC order; an empty one selects ITU-R BS.775 coefficients.
+ */
+class PCMConverter
+:
+	private Uncopyable
+{
+public:
+	typedef std::vector<float> DownmixMatrix;
+
+	static DownmixMatrix defaultDownmixMatrix(const ChannelCount&);
+
+	PCMConverter(const SampleSize&, const ChannelCount&,
+		const DownmixMatrix& = DownmixMatrix(), bool vectorize = true);
+
+	// channel count of floating-point samples, after any downmix
+	ChannelCount floatChannelCount() const;
+
+	// the following take and produce a number of whole frames
+	void toStereo16(const byte_t* in, byte_t* out, size_t frameCount);
+	void toFloat(const byte_t* in, float* out, size_t frameCount);
+	void floatToStereo16(const float* in, byte_t* out, size_t frameCount) const;
+
+	void reset();
+
+private:
+	void toFloatStereo(const byte_t* in, float* out, size_t frameCount);
+
+	typedef void (*IntegerKernel)(const byte_t*, int16_t*, size_t, uint32_t*);
+	typedef void (*FloatInKernel)(const byte_t*, float*, size_t);
+	typedef void (*FloatOutKernel)(const float*, int16_t*, size_t);
+	typedef void (*DownmixKernel)(const float*, float*, size_t, const float*);
+
+	IntegerKernel _toStereo16;
+	FloatInKernel _toFloat;
+	FloatOutKernel _floatToStereo16;
+	DownmixKernel _downmix;
+
+	const size_t _sampleSize;
+	const size_t _channelCount;
+
+	/** downmix coefficients, left and right for each channel in turn */
+	float _downmixCoefficients[16];
+	std::vector<float> _downmixBuffer;
+
+	/** dither generator state, one for each of four interleaved lanes */
+	uint32_t _ditherState[4];
+};
+
+
+#endif // PCMConverter_h
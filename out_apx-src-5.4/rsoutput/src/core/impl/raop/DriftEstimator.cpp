@@ -0,0 +1,135 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "DriftEstimator.h"
+#include <algorithm>
+#include <cassert>
+
+
+using Poco::Timestamp;
+
+
+// devices send timing requests about every three seconds, so this covers
+// a little over three minutes
+static const size_t SAMPLE_WINDOW = 64;
+
+// fewest samples, and shortest time they span, to fit a line through
+static const size_t SAMPLE_MIN_COUNT = 16;
+static const Timestamp::TimeDiff SAMPLE_MIN_SPAN = 30000000;
+
+
+DriftEstimator::DriftEstimator()
+:
+	_samples(SAMPLE_WINDOW)
+{
+	_scratch.reserve(SAMPLE_WINDOW * SAMPLE_WINDOW / 4);
+	reset();
+}
+
+
+void DriftEstimator::reset()
+{
+	_sampleCount = 0;
+	_skew = 0.0;
+	_offset = 0;
+}
+
+
+void DriftEstimator::addSample(const Timestamp& localTime, const Timestamp& remoteTime)
+{
+	Sample& sample = _samples[_sampleCount % SAMPLE_WINDOW];
+	sample.localTime = localTime.epochMicroseconds();
+	sample.offset = remoteTime - localTime;
+	_sampleCount += 1;
+
+	if (_sampleCount >= SAMPLE_MIN_COUNT)
+	{
+		fit();
+	}
+}
+
+
+bool DriftEstimator::isValid() const
+{
+	if (_sampleCount < SAMPLE_MIN_COUNT)
+	{
+		return false;
+	}
+
+	const size_t count = std::min(_sampleCount, SAMPLE_WINDOW);
+	const Sample& first = _samples[(_sampleCount - count) % SAMPLE_WINDOW];
+	const Sample& last = _samples[(_sampleCount - 1) % SAMPLE_WINDOW];
+
+	return (last.localTime - first.localTime >= SAMPLE_MIN_SPAN);
+}
+
+
+double DriftEstimator::skew() const
+{
+	return _skew;
+}
+
+
+Timestamp::TimeDiff DriftEstimator::offset() const
+{
+	return _offset;
+}
+
+
+void DriftEstimator::fit()
+{
+	const size_t count = std::min(_sampleCount, SAMPLE_WINDOW);
+	const size_t first = (_sampleCount - count);
+	const size_t gap = count / 2;
+
+	// slopes of pairs far enough apart that delay jitter hardly moves them
+	_scratch.clear();
+	for (size_t i = 0; i + gap < count; ++i)
+	{
+		const Sample& a = _samples[(first + i) % SAMPLE_WINDOW];
+		for (size_t j = i + gap; j < count; ++j)
+		{
+			const Sample& b = _samples[(first + j) % SAMPLE_WINDOW];
+			if (b.localTime > a.localTime)
+			{
+				_scratch.push_back(static_cast<double>(b.offset - a.offset)
+					/ static_cast<double>(b.localTime - a.localTime));
+			}
+		}
+	}
+	if (_scratch.empty())
+	{
+		return;
+	}
+
+	std::vector<double>::iterator median = _scratch.begin() + _scratch.size() / 2;
+	std::nth_element(_scratch.begin(), median, _scratch.end());
+	_skew = *median;
+
+	// intercept is median of offsets with skew taken out, placed at latest sample
+	const Sample& last = _samples[(_sampleCount - 1) % SAMPLE_WINDOW];
+	_scratch.clear();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Sample& s = _samples[(first + i) % SAMPLE_WINDOW];
+		_scratch.push_back(static_cast<double>(s.offset)
+			+ _skew * static_cast<double>(last.localTime - s.localTime));
+	}
+
+	median = _scratch.begin() + _scratch.size() / 2;
+	std::nth_element(_scratch.begin(), median, _scratch.end());
+	_offset = static_cast<Timestamp::TimeDiff>(*median);
+}
@@ -0,0 +1,70 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef DriftEstimator_h
+#define DriftEstimator_h
+
+
+#include "Platform.h"
+#include <vector>
+#include <Poco/Timestamp.h>
+
+
+/**
+ * Estimates how fast a remote clock runs relative to the local one from the
+ * timing requests a device sends, each pairing the remote time it was sent
+ * with the local time it arrived.  Their difference is the clock offset plus
+ * a network delay that varies, so a line is fitted through a window of them
+ * with the Theil-Sen estimator, taking the median slope of pairs at least
+ * half a window apart, which ignores delay spikes and lost requests alike.
+ */
+class DriftEstimator
+{
+public:
+	DriftEstimator();
+
+	void reset();
+
+	void addSample(const Poco::Timestamp& localTime, const Poco::Timestamp& remoteTime);
+
+	// true once samples span long enough for skew to be meaningful
+	bool isValid() const;
+
+	// remote clock rate relative to local one, less one (positive if faster)
+	double skew() const;
+
+	// remote time less local time, as fitted at the latest sample
+	Poco::Timestamp::TimeDiff offset() const;
+
+private:
+	void fit();
+
+	struct Sample
+	{
+		Poco::Timestamp::TimeVal localTime;
+		Poco::Timestamp::TimeDiff offset;
+	};
+
+	std::vector<Sample> _samples; // ring of most recent samples
+	size_t _sampleCount;
+
+	double _skew;
+	Poco::Timestamp::TimeDiff _offset;
+	std::vector<double> _scratch;
+};
+
+
+#endif // DriftEstimator_h
@@ -0,0 +1,106 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "FrameQueue.h"
+#include "PowerOfTwo.h"
+#include <cassert>
+#include <stdexcept>
+
+
+FrameQueue::FrameQueue(const size_t frameMaxSize, const uint16_t slotCount)
+:
+	_slotLength(sizeof(Slot) + frameMaxSize),
+	_slotMask(PowerOfTwo::roundUp(slotCount) - 1),
+	_buffer((_slotMask + 1) * _slotLength)
+{
+	reset();
+}
+
+
+FrameQueue::~FrameQueue()
+{
+}
+
+
+void FrameQueue::reset()
+{
+	_writeCount.store(0, std::memory_order_relaxed);
+	_readCount.store(0, std::memory_order_relaxed);
+}
+
+
+bool FrameQueue::canWrite() const
+{
+	return (_writeCount.load(std::memory_order_relaxed)
+		- _readCount.load(std::memory_order_acquire)) <= _slotMask;
+}
+
+
+bool FrameQueue::canRead() const
+{
+	return (_writeCount.load(std::memory_order_acquire)
+		!= _readCount.load(std::memory_order_relaxed));
+}
+
+
+FrameQueue::Slot& FrameQueue::nextAvailable()
+{
+	if (!canWrite())
+	{
+		throw std::logic_error("Can't write at this time");
+	}
+
+	return slotAt(_writeCount.load(std::memory_order_relaxed));
+}
+
+
+void FrameQueue::commitWrite()
+{
+	assert(canWrite());
+
+	// release makes slot contents visible before consumer sees new count
+	_writeCount.store(_writeCount.load(std::memory_order_relaxed) + 1,
+		std::memory_order_release);
+}
+
+
+const FrameQueue::Slot& FrameQueue::nextBuffered() const
+{
+	if (!canRead())
+	{
+		throw std::logic_error("Can't read at this time");
+	}
+
+	return slotAt(_readCount.load(std::memory_order_relaxed));
+}
+
+
+void FrameQueue::commitRead()
+{
+	assert(canRead());
+
+	// release keeps slot reads ahead of producer's reuse of slot
+	_readCount.store(_readCount.load(std::memory_order_relaxed) + 1,
+		std::memory_order_release);
+}
+
+
+FrameQueue::Slot& FrameQueue::slotAt(const size_t count) const
+{
+	const byte_t* const ptr = &_buffer[(count & _slotMask) * _slotLength];
+
+	return *reinterpret_cast<Slot*>(const_cast<byte_t*>(ptr));
+}
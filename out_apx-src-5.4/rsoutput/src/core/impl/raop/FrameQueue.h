@@ -0,0 +1,76 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef FrameQueue_h
+#define FrameQueue_h
+
+
+#include "Platform.h"
+#include "RAOPDefs.h"
+#include "Uncopyable.h"
+#include <atomic>
+
+
+/**
+ * Fixed-capacity queue of raw audio frames handed from a single producer
+ * thread to a single consumer thread without locking.  The producer fills
+ * nextAvailable() and then calls commitWrite(); the consumer examines
+ * nextBuffered() and then calls commitRead() to return the slot.
+ */
+class FrameQueue
+:
+	private Uncopyable
+{
+public:
+	FrameQueue(size_t frameMaxSize, uint16_t slotCount);
+	~FrameQueue();
+
+	void reset(); // only while neither thread is active
+
+	bool canWrite() const;
+	bool canRead() const;
+
+	struct Slot {
+		DataPacketHeader packetHeader; // in network byte order
+		size_t frameSize; // whole packet except at end of stream
+#pragma warning(push)
+#pragma warning(disable:4200)
+		byte_t frameData[];
+#pragma warning(pop)
+	};
+
+	      Slot& nextAvailable();
+	void commitWrite();
+
+	const Slot& nextBuffered() const;
+	void commitRead();
+
+private:
+	Slot& slotAt(size_t count) const;
+
+	const size_t _slotLength;
+	const size_t _slotMask;
+	buffer_t _buffer;
+
+	// counters are kept on separate cache lines so that producer and consumer
+	// do not contend for the same line when each advances its own position
+	std::atomic<size_t> _writeCount;
+	byte_t _padding[64];
+	std::atomic<size_t> _readCount;
+};
+
+
+#endif // FrameQueue_h
@@ -0,0 +1,69 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "MediaClock.h"
+
+
+using Poco::Timestamp;
+
+
+static int64_t queryFrequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+}
+
+
+MediaClock::Time MediaClock::performanceCounter()
+{
+	// performance counter frequency is fixed at boot
+	static const int64_t frequency = queryFrequency();
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// whole seconds and remainder are scaled apart so as not to overflow
+	return (counter.QuadPart / frequency) * NANOSECONDS_PER_SECOND
+		+ ((counter.QuadPart % frequency) * NANOSECONDS_PER_SECOND) / frequency;
+}
+
+
+Timestamp MediaClock::systemTime()
+{
+	return Timestamp();
+}
+
+
+MediaClock::MediaClock(const TickSource tickSource, const WallSource wallSource)
+:
+	_tickSource(tickSource),
+	_originTime(tickSource()),
+	_originTimestamp(wallSource())
+{
+}
+
+
+Timestamp MediaClock::toTimestamp(const Time time) const
+{
+	return _originTimestamp + (time - _originTime) / NANOSECONDS_PER_MICROSECOND;
+}
+
+
+NTPTimestamp MediaClock::toNTPTimestamp(const Time time) const
+{
+	return NTPTimestamp(toTimestamp(time));
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef MediaClock_h
+#define MediaClock_h
+
+
+#include "NTPTimestamp.h"
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <Poco/Timestamp.h>
+
+
+/**
+ * Monotonic clock that audio streams are paced by.  It reads the performance
+ * counter, which system time adjustments do not move, in nanoseconds.  Time
+ * devices see in sync and timing packets is derived from it by a mapping to
+ * wall-clock time taken once, on construction, and never re-anchored: devices
+ * only see our time through packets that both use the mapping, so moving it
+ * would look to them like our clock jumping.  It drifts from wall-clock time
+ * as far as the two clocks disagree in rate, which devices follow like any
+ * other difference between their clock and ours.
+ */
+class MediaClock
+:
+	private Uncopyable
+{
+public:
+	typedef int64_t Time; // in nanoseconds
+
+	static const Time NANOSECONDS_PER_MICROSECOND = 1000;
+	static const Time NANOSECONDS_PER_SECOND = 1000000000;
+
+	// sources of monotonic and of wall-clock time; tests substitute their
+	// own so that they can step either one
+	typedef Time (*TickSource)();
+	typedef Poco::Timestamp (*WallSource)();
+	static Time performanceCounter();
+	static Poco::Timestamp systemTime();
+
+	explicit MediaClock(TickSource = performanceCounter, WallSource = systemTime);
+
+	Time now() const;
+
+	Poco::Timestamp toTimestamp(Time) const;
+	NTPTimestamp toNTPTimestamp(Time) const;
+
+private:
+	const TickSource _tickSource;
+	const Time _originTime;
+	const Poco::Timestamp _originTimestamp;
+};
+
+
+inline MediaClock::Time MediaClock::now() const
+{
+	return _tickSource();
+}
+
+
+#endif // MediaClock_h
@@ -0,0 +1,117 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PacingTimer.h"
+#include "Platform.inl"
+#include <cassert>
+#include <stdexcept>
+
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+
+static HANDLE createTimer()
+{
+	typedef HANDLE (WINAPI *CreateWaitableTimerExProc)(void*, const wchar_t*, DWORD, DWORD);
+
+	// high-resolution timers (Windows 10 1803 and later) are not bound to the
+	// system timer interval, so look for them at runtime and fall back to the
+	// standard synchronization timer on older systems
+	const CreateWaitableTimerExProc createWaitableTimerEx =
+		reinterpret_cast<CreateWaitableTimerExProc>(GetProcAddress(
+			GetModuleHandle(TEXT("kernel32.dll")), "CreateWaitableTimerExW"));
+	if (createWaitableTimerEx != NULL)
+	{
+		const HANDLE timer = createWaitableTimerEx(NULL, NULL,
+			CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (timer != NULL)
+		{
+			return timer;
+		}
+	}
+
+	return CreateWaitableTimer(NULL, FALSE, NULL);
+}
+
+
+PacingTimer::PacingTimer(const MediaClock& mediaClock)
+:
+	_mediaClock(mediaClock),
+	_timer(createTimer()),
+	_event(CreateEvent(NULL, FALSE, FALSE, NULL))
+{
+	if (_timer == NULL || _event == NULL)
+	{
+		if (_timer != NULL) CloseHandle(_timer);
+		if (_event != NULL) CloseHandle(_event);
+
+		throw std::runtime_error("CreateWaitableTimer or CreateEvent failed: "
+			+ Platform::Error::describeLast());
+	}
+}
+
+
+PacingTimer::~PacingTimer()
+{
+	CloseHandle(_event);
+	CloseHandle(_timer);
+}
+
+
+bool PacingTimer::waitUntil(const MediaClock::Time deadline)
+{
+	const MediaClock::Time remaining = deadline - _mediaClock.now();
+	if (remaining <= 0)
+	{
+		return true;
+	}
+
+	// relative due time is expressed in negative 100-nanosecond intervals
+	LARGE_INTEGER dueTime;
+	dueTime.QuadPart = -((remaining + 99) / 100);
+
+	if (!SetWaitableTimer(_timer, &dueTime, 0, NULL, NULL, FALSE))
+	{
+		throw std::runtime_error("SetWaitableTimer failed: "
+			+ Platform::Error::describeLast());
+	}
+
+	const HANDLE handles[] = { _event, _timer };
+	const DWORD result = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+
+	switch (result)
+	{
+	case WAIT_OBJECT_0:
+		// signalled early; leave no stale expiration behind for next wait
+		CancelWaitableTimer(_timer);
+		return false;
+
+	case WAIT_OBJECT_0 + 1:
+		return true;
+
+	default:
+		throw std::runtime_error("WaitForMultipleObjects failed: "
+			+ Platform::Error::describeLast());
+	}
+}
+
+
+void PacingTimer::signal()
+{
+	SetEvent(_event);
+}
@@ -0,0 +1,53 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PacingTimer_h
+#define PacingTimer_h
+
+
+#include "MediaClock.h"
+#include "Platform.h"
+#include "Uncopyable.h"
+
+
+/**
+ * Waitable timer for pacing a sender thread against absolute deadlines.  The
+ * waiting thread is released when its deadline passes or when another thread
+ * signals that there is new work to look at, whichever comes first.
+ * Deadlines are in time of the media clock given on construction.
+ */
+class PacingTimer
+:
+	private Uncopyable
+{
+public:
+	explicit PacingTimer(const MediaClock&);
+	~PacingTimer();
+
+	// returns true if deadline was reached; false if signalled beforehand
+	bool waitUntil(MediaClock::Time deadline);
+
+	// releases waiting thread (or next thread to wait) early
+	void signal();
+
+private:
+	const MediaClock& _mediaClock;
+	HANDLE _timer;
+	HANDLE _event;
+};
+
+
+#endif // PacingTimer_h
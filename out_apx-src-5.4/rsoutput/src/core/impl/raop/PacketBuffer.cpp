@@ -15,17 +15,25 @@
  */
 
 #include "PacketBuffer.h"
+#include "PowerOfTwo.h"
+#include <algorithm>
 #include <cassert>
-#include <cstring>
 #include <stdexcept>
 
 
+// keep slots aligned to cache lines so neighboring packets never share one
+static const size_t SLOT_ALIGNMENT = 64;
+
+
 PacketBuffer::PacketBuffer(const size_t packetMaxSize, const uint16_t headLength, const uint16_t tailLength)
 :
-	_slotLength(sizeof(Slot) + packetMaxSize),
-	_headLength(headLength * _slotLength),
-	_tailLength(tailLength * _slotLength),
-	_buffer(_headLength + _tailLength)
+	_slotLength((sizeof(Slot) + packetMaxSize + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1)),
+	// at least one slot beyond head is needed so last read slot isn't reused while in use
+	_slotMask(PowerOfTwo::roundUp(headLength + std::max<size_t>(tailLength, 1)) - 1),
+	_headCount(headLength),
+	_tailCapacity(tailLength),
+	_tailCount(tailLength),
+	_buffer((_slotMask + 1) * _slotLength + SLOT_ALIGNMENT)
 {
 	reset();
 }
@@ -38,20 +46,35 @@ PacketBuffer::~PacketBuffer()
 
 void PacketBuffer::reset()
 {
-	_bufferAvailability = _headLength;
-	_bufferReadIndex = _bufferWriteIndex = 0;
+	_writeCount.store(0, std::memory_order_relaxed);
+	_readCount.store(0, std::memory_order_relaxed);
+}
+
+
+uint16_t PacketBuffer::tailLength() const
+{
+	return static_cast<uint16_t>(_tailCount.load(std::memory_order_relaxed));
+}
+
+
+void PacketBuffer::setTailLength(const uint16_t tailLength)
+{
+	// slots beyond capacity would already have been overwritten by the head
+	_tailCount.store(std::min<size_t>(tailLength, _tailCapacity), std::memory_order_relaxed);
 }
 
 
 bool PacketBuffer::canWrite() const
 {
-	return (_bufferAvailability > 0);
+	return (_writeCount.load(std::memory_order_relaxed)
+		- _readCount.load(std::memory_order_acquire)) < _headCount;
 }
 
 
 bool PacketBuffer::canRead() const
 {
-	return (_bufferAvailability < _headLength);
+	return (_writeCount.load(std::memory_order_acquire)
+		!= _readCount.load(std::memory_order_relaxed));
 }
 
 
@@ -62,14 +85,18 @@ PacketBuffer::Slot& PacketBuffer::nextAvailable()
 		throw std::logic_error("Can't write at this time");
 	}
 
-	byte_t* const ptr = &_buffer[_bufferWriteIndex];
+	// slot is reused as is; producer overwrites every field it publishes
+	return slotAt(_writeCount.load(std::memory_order_relaxed));
+}
 
-	std::memset(ptr, 0, _slotLength);
 
-	_bufferAvailability -= _slotLength;
-	_bufferWriteIndex = (_bufferWriteIndex + _slotLength) % _buffer.size();
+void PacketBuffer::commitWrite()
+{
+	assert(canWrite());
 
-	return *reinterpret_cast<Slot*>(ptr);
+	// release makes slot contents visible before consumer sees new count
+	_writeCount.store(_writeCount.load(std::memory_order_relaxed) + 1,
+		std::memory_order_release);
 }
 
 
@@ -80,28 +107,34 @@ PacketBuffer::Slot& PacketBuffer::nextBuffered()
 		throw std::logic_error("Can't read at this time");
 	}
 
-	byte_t* const ptr = &_buffer[_bufferReadIndex];
+	const size_t readCount = _readCount.load(std::memory_order_relaxed);
 
-	_bufferAvailability += _slotLength;
-	_bufferReadIndex = (_bufferReadIndex + _slotLength) % _buffer.size();
+	_readCount.store(readCount + 1, std::memory_order_release);
 
-	return *reinterpret_cast<Slot*>(ptr);
+	return slotAt(readCount);
 }
 
 
 const PacketBuffer::Slot& PacketBuffer::prevBuffered(const uint16_t tailIndex) const
 {
-	if (tailIndex < 1 || tailIndex > (_tailLength / _slotLength))
+	const size_t readCount = _readCount.load(std::memory_order_relaxed);
+
+	if (tailIndex < 1 || tailIndex > _tailCount.load(std::memory_order_relaxed))
 	{
 		throw std::logic_error("Can't find requested packet");
 	}
 
-	const size_t indexDiff = (tailIndex * _slotLength);
-	const size_t prevIndex = (indexDiff <= _bufferReadIndex
-		? _bufferReadIndex - indexDiff
-		: _buffer.size() - (indexDiff - _bufferReadIndex));
-	assert(prevIndex <= (_buffer.size() - _slotLength));
-	assert(prevIndex % _slotLength == 0);
+	return slotAt(readCount - tailIndex);
+}
+
+
+PacketBuffer::Slot& PacketBuffer::slotAt(const size_t count) const
+{
+	// align first slot within buffer, whose storage has no alignment guarantee
+	const size_t base = reinterpret_cast<size_t>(&_buffer[0]);
+	const size_t offset = ((base + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1)) - base;
+
+	const byte_t* const ptr = &_buffer[offset + (count & _slotMask) * _slotLength];
 
-	return *reinterpret_cast<const Slot*>(&_buffer[prevIndex]);
+	return *reinterpret_cast<Slot*>(const_cast<byte_t*>(ptr));
 }
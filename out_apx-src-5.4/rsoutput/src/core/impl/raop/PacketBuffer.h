@@ -20,8 +20,16 @@
 
 #include "Platform.h"
 #include "Uncopyable.h"
+#include <atomic>
 
 
+/**
+ * Ring of packet slots shared by a single producer thread and a single
+ * consumer thread without locking.  The producer fills nextAvailable() and
+ * then publishes it with commitWrite(); the consumer takes nextBuffered(),
+ * after which the slot is retained as history for prevBuffered() until the
+ * producer wraps around to it again.
+ */
 class PacketBuffer
 :
 	private Uncopyable
@@ -30,7 +38,11 @@ public:
 	PacketBuffer(size_t packetMaxSize, uint16_t headLength, uint16_t tailLength = 0);
 	~PacketBuffer();
 
-	void reset();
+	void reset(); // only while neither thread is active
+
+	// history kept for prevBuffered(), up to the tail length constructed with
+	uint16_t tailLength() const;
+	void setTailLength(uint16_t);
 
 	bool canWrite() const;
 	bool canRead() const;
@@ -40,6 +52,7 @@ public:
 		size_t payloadSize;
 		size_t originalSize; // of payload before compression, encoding or padding
 		uint16_t frameCount;
+		bool secured; // payload is encrypted
 #pragma warning(push)
 #pragma warning(disable:4200)
 		byte_t packetData[];
@@ -47,17 +60,25 @@ public:
 	};
 
 	      Slot& nextAvailable();
+	void commitWrite();
 	      Slot& nextBuffered();
 	const Slot& prevBuffered(uint16_t tailIndex) const;
 
 private:
+	Slot& slotAt(size_t count) const;
+
 	const size_t _slotLength;
-	const size_t _headLength;
-	const size_t _tailLength;
-	size_t _bufferAvailability;
-	size_t _bufferReadIndex;
-	size_t _bufferWriteIndex;
+	const size_t _slotMask;
+	const size_t _headCount;
+	const size_t _tailCapacity;
+	std::atomic<size_t> _tailCount;
 	buffer_t _buffer;
+
+	// counters only ever increase; they are kept on separate cache lines so
+	// that producer and consumer do not contend when advancing them
+	std::atomic<size_t> _writeCount;
+	byte_t _padding[64];
+	std::atomic<size_t> _readCount;
 };
 
 
@@ -0,0 +1,52 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PowerOfTwo_h
+#define PowerOfTwo_h
+
+
+#include <cstddef>
+
+
+/**
+ * Power-of-two sizing for ring buffers, whose slot indices wrap by masking.
+ */
+class PowerOfTwo
+{
+public:
+	// returns smallest power of two not less than n (and 1 for 0)
+	static size_t roundUp(size_t n);
+
+private:
+	PowerOfTwo();
+};
+
+
+//------------------------------------------------------------------------------
+
+
+inline size_t PowerOfTwo::roundUp(const size_t n)
+{
+	size_t p = 1;
+	while (p < n)
+	{
+		p <<= 1;
+	}
+	return p;
+}
+
+
+#endif // PowerOfTwo_h
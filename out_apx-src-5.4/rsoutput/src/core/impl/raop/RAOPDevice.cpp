@@ -90,7 +90,10 @@ RAOPDevice::RAOPDevice(RAOPEngine& raopEngine,
 	_metadataFlags(metadataFlags),
 	_raopEngine(raopEngine),
 	_deviceVolume(0),
-	_audioLatency(0)
+	_audioLatency(0),
+	_connected(false),
+	_resendRequestCount(0),
+	_resendAgeMax(0)
 {
 	// generate DACP remote control identifier
 	Random::fill(&_remoteControlId, sizeof(uint32_t));
@@ -338,3 +341,22 @@ void RAOPDevice::updateProgress(const OutputInterval& interval)
 		_rtspClient->doSetParameter("progress", Poco::format("%u/%u/%u", beg, pos, end));
 	}
 }
+
+
+void RAOPDevice::setConnected(const bool connected)
+{
+	// device may let go of its RTSP client while connected, so keep socket
+	if (connected)
+	{
+		_connectedSocket = _rtspClient->socket();
+	}
+	_connected = connected;
+}
+
+
+void RAOPDevice::resetStreamState()
+{
+	_resendRequestCount = 0;
+	_resendAgeMax = 0;
+	_clockDrift.reset();
+}
@@ -18,10 +18,14 @@
 #define RAOPDevice_h
 
 
+#include "DriftEstimator.h"
 #include "Platform.h"
 #include "Uncopyable.h"
 #include "impl/Device.h"
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <Poco/Net/Socket.h>
 #include <Poco/Net/SocketAddress.h>
 
 
@@ -50,6 +54,7 @@ public:
 	int test(Poco::Net::StreamSocket&, bool firstTime);
 	int open(Poco::Net::StreamSocket&, AudioJackStatus&);
 	bool isOpen(bool pollConnection = true) const;
+	bool isConnected() const; // as last seen by engine, without polling
 	void close();
 	void flush();
 
@@ -68,6 +73,15 @@ public:
 	const Poco::Net::SocketAddress& controlSocketAddr() const;
 	const Poco::Net::SocketAddress& timingSocketAddr() const;
 
+	// stream state kept by engine while device is attached
+	void setConnected(bool); // watches RTSP socket in use when connected
+	const Poco::Net::Socket& connectedSocket() const;
+	void countResendRequest(uint16_t missedPktAge);
+	void takeResendRequests(uint32_t& count, uint16_t& ageMax);
+	DriftEstimator& clockDrift();
+	const DriftEstimator& clockDrift() const;
+	void resetStreamState();
+
 private:
 	              class RAOPEngine& _raopEngine;
 	std::auto_ptr<class RTSPClient> _rtspClient;
@@ -83,6 +97,19 @@ private:
 	/** device's audio playback latency (in number of samples) */
 	unsigned int _audioLatency;
 
+	/** RTSP connection state, kept up to date by engine's socket reactor */
+	std::atomic<bool> _connected;
+	Poco::Net::Socket _connectedSocket;
+
+	/** resend requests since engine last sized its packet buffer, and age of
+	    oldest packet asked for (guarded by engine's mutex) */
+	uint32_t _resendRequestCount;
+	uint16_t _resendAgeMax;
+
+	/** device's clock relative to ours, from its timing requests (guarded by
+	    engine's mutex) */
+	DriftEstimator _clockDrift;
+
 	/** device's DACP remote control identifier */
 	uint32_t _remoteControlId;
 
@@ -93,6 +120,46 @@ private:
 };
 
 
+inline bool RAOPDevice::isConnected() const
+{
+	return _connected.load(std::memory_order_relaxed);
+}
+
+
+inline const Poco::Net::Socket& RAOPDevice::connectedSocket() const
+{
+	return _connectedSocket;
+}
+
+
+inline void RAOPDevice::countResendRequest(const uint16_t missedPktAge)
+{
+	_resendRequestCount += 1;
+	_resendAgeMax = std::max(_resendAgeMax, missedPktAge);
+}
+
+
+inline void RAOPDevice::takeResendRequests(uint32_t& count, uint16_t& ageMax)
+{
+	count = _resendRequestCount;
+	ageMax = _resendAgeMax;
+	_resendRequestCount = 0;
+	_resendAgeMax = 0;
+}
+
+
+inline DriftEstimator& RAOPDevice::clockDrift()
+{
+	return _clockDrift;
+}
+
+
+inline const DriftEstimator& RAOPDevice::clockDrift() const
+{
+	return _clockDrift;
+}
+
+
 inline unsigned int RAOPDevice::audioLatency() const
 {
 	return _audioLatency;
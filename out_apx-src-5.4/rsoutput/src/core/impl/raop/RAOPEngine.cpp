@@ -44,6 +44,7 @@
 #pragma warning(disable:4146)
 #pragma warning(disable:4244)
 #pragma warning(disable:4805)
+#include <ALACCpu.c>
 #include <ag_dec.c>
 #include <ag_enc.c>
 #include <dp_enc.c>
@@ -59,18 +60,69 @@ using Poco::ByteOrder;
 using Poco::Thread;
 using Poco::Timestamp;
 using Poco::Net::DatagramSocket;
+using Poco::Net::ErrorNotification;
 using Poco::Net::IPAddress;
+using Poco::Net::Socket;
 using Poco::Net::SocketAddress;
 using Poco::Net::ReadableNotification;
+using Poco::Net::TimeoutNotification;
 
 
 // default ports to use for RTP control and timing
 static const uint16_t LOCAL_CONTROL_PORT = 6001;
 static const uint16_t LOCAL_TIMING_PORT = 6002;
 
-// buffer approximately 2 seconds of unsent and 4 seconds of sent packets
+// buffer at most approximately 2 seconds of unsent and 4 seconds of sent
+// packets, and at least half a second of each
 static const uint16_t PACKET_BUFFER_COUNT = 250;
 static const uint16_t PACKET_MEMORY_COUNT = 500;
+static const uint16_t PACKET_BUFFER_MIN_COUNT = 64;
+static const uint16_t PACKET_MEMORY_MIN_COUNT = 64;
+
+// packet buffer depth is reconsidered about once per second
+static const uint16_t PACKET_BUFFER_INTERVAL = 128;
+
+// redundant audio sends each packet again 8 packets (about 64 ms) later, far
+// enough apart that a burst of loss on a wireless link seldom takes both
+static const uint16_t REDUNDANT_PACKET_OFFSET = 8;
+
+// thread making an RTSP request reads its response within a few milliseconds
+// of it arriving; reactor stops watching a connection whose data sits unread
+// longer than that, and takes data seen much later to be another response
+static const Timestamp::TimeDiff RTSP_RESPONSE_GRACE = 5000;
+static const Timestamp::TimeDiff RTSP_RESPONSE_WINDOW = 100000;
+
+// queue up to 32 raw audio frames between writer and encoder threads
+static const uint16_t FRAME_QUEUE_COUNT = 32;
+
+// packet of 352 samples covers just under 8 ms of audio; adaptive encoding
+// moves to cheaper modes when encoding takes more than a quarter of that
+static const Timestamp::TimeDiff ENCODE_TIME_BUDGET = 7982;
+static const Timestamp::TimeDiff ENCODE_TIME_LIMIT = ENCODE_TIME_BUDGET / 4;
+
+// adaptive encoding reconsiders its mode about twice per second
+static const uint32_t ADAPTIVE_INTERVAL = 64;
+
+// largest device clock drift the stream rate follows (as a fraction)
+static const double DRIFT_MAX = 0.0002;
+
+// stream rate follows device clocks once they move this far (as a fraction),
+// so estimation noise does not keep shifting due times
+static const double DRIFT_HYSTERESIS = 0.000002;
+
+// send a sync packet to each device once per second
+static const MediaClock::Time SYNC_PACKET_INTERVAL = MediaClock::NANOSECONDS_PER_SECOND;
+
+// sync packets tell devices to play each frame this many samples after it is
+// sent, before adding the audio latency of their own
+static const uint32_t SYNC_LATENCY = 77175;
+
+// low latency profile leaves devices a quarter second to absorb jitter and
+// resends, keeps at most about 125 ms queued and syncs four times as often
+static const uint32_t LOW_LATENCY_SYNC_LATENCY = 11025;
+static const uint16_t LOW_LATENCY_PACKET_BUFFER_COUNT = 16;
+static const uint16_t LOW_LATENCY_PACKET_BUFFER_MIN_COUNT = 8;
+static const MediaClock::Time LOW_LATENCY_SYNC_PACKET_INTERVAL = SYNC_PACKET_INTERVAL / 4;
 
 const unsigned int RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL = 352;
 const unsigned int RAOP_SAMPLES_PER_SECOND = 44100;
@@ -121,6 +173,52 @@ static const AudioFormatDescription ALAC_IN_FORMAT(alac_in_format());
 static const AudioFormatDescription ALAC_OUT_FORMAT(alac_out_format());
 
 
+// ALACEncoder only writes escape (uncompressed) frames as a fallback, so this
+// exposes them for the raw encoder mode
+class ALACStreamEncoder
+:
+	public ALACEncoder
+{
+public:
+	int32_t EncodeEscape(unsigned char* readBuffer, unsigned char* writeBuffer, int32_t* ioNumBytes)
+	{
+		const uint32_t numFrames = *ioNumBytes / ALAC_IN_FORMAT.mBytesPerPacket;
+
+		BitBuffer bitstream;
+		BitBufferInit(&bitstream, writeBuffer, mMaxOutputBytes);
+
+		// channel pair element, same as Encode writes for stereo input
+		BitBufferWrite(&bitstream, ID_CPE, 3);
+		BitBufferWrite(&bitstream, 0, 4);
+
+		const int32_t status = EncodeStereoEscape(&bitstream, readBuffer, 2, numFrames);
+
+		BitBufferWrite(&bitstream, ID_END, 3);
+		BitBufferByteAlign(&bitstream, true);
+
+		*ioNumBytes = BitBufferGetPosition(&bitstream) / 8;
+		return status;
+	}
+
+	// fast mode writes its compressed frame straight to the output and only
+	// then falls back to an escape frame, so give it worst-case room to do so
+	int32_t EncodeFast(unsigned char* readBuffer, unsigned char* writeBuffer, int32_t* ioNumBytes)
+	{
+		_fastBuffer.resize(mMaxOutputBytes);
+		SetFastMode(true);
+
+		const int32_t status = Encode(ALAC_IN_FORMAT, ALAC_OUT_FORMAT,
+			readBuffer, &_fastBuffer[0], ioNumBytes);
+
+		std::memcpy(writeBuffer, &_fastBuffer[0], *ioNumBytes);
+		return status;
+	}
+
+private:
+	buffer_t _fastBuffer;
+};
+
+
 //------------------------------------------------------------------------------
 
 
@@ -153,6 +251,22 @@ static void bindToNextAvailablePort(DatagramSocket& socket, uint16_t port)
 }
 
 
+static bool isConnectionClosed(const Socket& socket)
+{
+	try
+	{
+		// readable with nothing to read means peer closed or reset connection;
+		// check again in case a response came in and was read in between
+		return socket.poll(0, Socket::SELECT_ERROR) || (socket.available() == 0
+			&& socket.poll(0, Socket::SELECT_READ) && socket.available() == 0);
+	}
+	catch (...)
+	{
+		return true;
+	}
+}
+
+
 static void sendTo(DatagramSocket& socket, const SocketAddress& address,
 	const void* const buffer, const size_t length)
 {
@@ -178,11 +292,11 @@ const OutputFormat& RAOPEngine::outputFormat()
 }
 
 
-int64_t RAOPEngine::samplesToMicroseconds(const int64_t samples)
+MediaClock::Time RAOPEngine::samplesToMediaTime(const int64_t samples)
 {
-	static const int64_t MICROSECONDS_PER_SECOND = 1000000;
-
-	return ((samples * MICROSECONDS_PER_SECOND) / RAOP_SAMPLES_PER_SECOND);
+	// whole seconds and remainder are scaled apart so as not to overflow
+	return (samples / RAOP_SAMPLES_PER_SECOND) * MediaClock::NANOSECONDS_PER_SECOND
+		+ ((samples % RAOP_SAMPLES_PER_SECOND) * MediaClock::NANOSECONDS_PER_SECOND) / RAOP_SAMPLES_PER_SECOND;
 }
 
 
@@ -201,13 +315,40 @@ RAOPEngine::RAOPEngine(OutputObserver& outputObserver)
 :
 	_aesIV(16),
 	_audioLatency(11025),
+	_latenessCount(0),
+	_sendCallCount(0),
+	_encoderMode(Options::ENCODE_FULL),
+	_encoderLevel(Options::ENCODE_FULL),
+	_pacingBaseSamples(0),
+	_driftRatio(1.0),
+	_driftRatioTime(0),
+	_sendTable(new SendTable),
+	_connectionClosed(false),
 	_outputObserver(outputObserver),
-	_rtpDataSecured(RAOP_PACKET_MAX_SIZE, PACKET_BUFFER_COUNT, PACKET_MEMORY_COUNT),
-	_rtpDataUnsecured(RAOP_PACKET_MAX_SIZE, PACKET_BUFFER_COUNT, PACKET_MEMORY_COUNT),
+	_pcmFrames(RAOP_PACKET_MAX_DATA_SIZE, FRAME_QUEUE_COUNT),
+	_rtpData(RAOP_PACKET_MAX_SIZE, PACKET_BUFFER_COUNT, PACKET_MEMORY_COUNT),
+	_convertedPacket(RAOP_PACKET_MAX_SIZE),
+	_redundantAudio(false),
+	_redundantPacket(RTP_BASE_HEADER_SIZE + RAOP_PACKET_MAX_SIZE),
+	_redundantSendCount(0),
+	_lostPacketCount(0),
+	_lostRedundantCount(0),
+	_packetBufferDepth(PACKET_BUFFER_COUNT),
+	_packetBufferLateCount(0),
+	_packetBufferMax(PACKET_BUFFER_COUNT),
+	_packetBufferMin(PACKET_BUFFER_MIN_COUNT),
+	_syncLatency(SYNC_LATENCY),
+	_syncInterval(SYNC_PACKET_INTERVAL),
 	_controlRequestHandler(*this, &RAOPEngine::handleControlRequest),
 	_timingRequestHandler(*this, &RAOPEngine::handleTimingRequest),
+	_connectionReadableHandler(*this, &RAOPEngine::handleConnectionReadable),
+	_connectionErrorHandler(*this, &RAOPEngine::handleConnectionError),
+	_reactorTimeoutHandler(*this, &RAOPEngine::handleReactorTimeout),
+	_pacingTimer(_mediaClock),
 	_reactorThread("RAOPEngine.SocketReactor::run"),
-	_senderThread("RAOPEngine::run")
+	_senderThread("RAOPEngine::run"),
+	_encoderThread("RAOPEngine::encode"),
+	_encoderRunnable(*this, &RAOPEngine::encode)
 {
 	// seed random number generator
 	Random::seed(static_cast<unsigned int>(std::time(NULL)));
@@ -292,6 +433,7 @@ RAOPEngine::RAOPEngine(OutputObserver& outputObserver)
 	bindToNextAvailablePort(_timingSocket, LOCAL_TIMING_PORT);
 	_socketReactor.addEventHandler(_controlSocket, _controlRequestHandler);
 	_socketReactor.addEventHandler(_timingSocket, _timingRequestHandler);
+	_socketReactor.addEventHandler(_controlSocket, _reactorTimeoutHandler);
 	_reactorThread.start(_socketReactor);
 }
 
@@ -323,6 +465,7 @@ void RAOPEngine::reinit(OutputInterval& outputInterval)
 	// test thread states
 	assert(_reactorThread.isRunning());
 	assert(!_senderThread.isRunning());
+	assert(!_encoderThread.isRunning());
 
 	// generate new AES encryption key
 	buffer_t key(16);
@@ -332,6 +475,10 @@ void RAOPEngine::reinit(OutputInterval& outputInterval)
 	{
 		throw std::runtime_error("AES_set_encrypt_key failed");
 	}
+	if (AES_set_decrypt_key(&key[0], key.size() * 8, &_aesDecryptKey))
+	{
+		throw std::runtime_error("AES_set_decrypt_key failed");
+	}
 
 	// RSA encrypt AES key
 	buffer_t encryptedKey(RSA_size(rsaKey()));
@@ -418,17 +565,40 @@ void RAOPEngine::reinit(OutputInterval& outputInterval)
 	Random::fill(&_rtpSsrc, sizeof(uint32_t));
 
 	// reinitialize remaining object state
-	_firstDataTime = _lastClockSyncTime = _lastStreamSyncTime = 0;
+	_pacingBaseTime = _lastStreamSyncTime = 0;
+	_lastClockSyncTime = 0;
+	_pacingBaseSamples = 0;
+	_driftRatio = 1.0;
+	_driftRatioTime = 0;
 	_isFirstDataPacket = _isFirstSyncPacket = true;
-	_rtpDataUnsecured.reset();
-	_rtpDataSecured.reset();
+	_rtpData.reset();
+	_pcmFrames.reset();
 	_raopDevices.clear();
+	updateSendTable();
 	_samplesWritten = 0;
 
-	_alacEncoder.reset(new ALACEncoder);
+	_alacEncoder.reset(new ALACStreamEncoder);
 	_alacEncoder->SetFrameSize(ALAC_OUT_FORMAT.mFramesPerPacket);
 	const int32_t result = _alacEncoder->InitializeEncoder(ALAC_OUT_FORMAT);
 	assert(result == 0);
+
+	// pick up encoder policy; adaptive policy starts out at full compression
+	const Options::SharedPtr options = Options::getOptions();
+	_encoderMode = (options.isNull() ? Options::ENCODE_FULL : options->getEncoderMode());
+	_encoderLevel = (_encoderMode == Options::ENCODE_ADAPTIVE ? Options::ENCODE_FULL : _encoderMode);
+	std::fill(_encodeTimeAverage, _encodeTimeAverage + Options::ENCODE_ADAPTIVE, 0);
+	_adaptivePacketCount = _adaptiveLateCount = 0;
+
+	// pick up latency profile; it holds for the whole stream
+	const bool lowLatency = (!options.isNull() && options->getLowLatency());
+	_syncLatency = (lowLatency ? LOW_LATENCY_SYNC_LATENCY : SYNC_LATENCY);
+	_syncInterval = (lowLatency ? LOW_LATENCY_SYNC_PACKET_INTERVAL : SYNC_PACKET_INTERVAL);
+	_packetBufferMax = (lowLatency ? LOW_LATENCY_PACKET_BUFFER_COUNT : PACKET_BUFFER_COUNT);
+	_packetBufferMin = (lowLatency ? LOW_LATENCY_PACKET_BUFFER_MIN_COUNT : PACKET_BUFFER_MIN_COUNT);
+	_packetBufferDepth = _packetBufferMax;
+
+	// pick up redundancy option, which applies to every device attached
+	_redundantAudio = (!options.isNull() && options->getRedundantAudio());
 }
 
 
@@ -473,17 +643,41 @@ time_t RAOPEngine::latency(const OutputFormat& format) const
 		throw std::logic_error("format != RAOPEngine::outputFormat()");
 	}
 
-	const time_t bufferLatency = samplesToMilliseconds(
-		PACKET_BUFFER_COUNT * RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL);
-	const time_t deviceLatency = samplesToMilliseconds(_audioLatency);
+	ScopedLock lock(_mutex);
 
-	return (bufferLatency + deviceLatency);
+	// frames written but not yet sent, queued for encoding or for sending
+	const uint32_t unsentSamples = (_rtpTimeIncoming - _rtpTimeOutgoing);
+
+	// playback waits for the slowest device, so take the largest latency
+	// reported, assuming the usual one for devices that report none
+	unsigned int audioLatency = 0;
+	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
+		it != _raopDevices.end(); ++it)
+	{
+		const unsigned int deviceLatency = (*it)->audioLatency();
+		audioLatency = std::max(audioLatency, deviceLatency > 0 ? deviceLatency : _audioLatency);
+	}
+	if (_raopDevices.empty())
+	{
+		audioLatency = _audioLatency;
+	}
+
+	return samplesToMilliseconds(unsentSamples + _syncLatency + audioLatency);
 }
 
 
 size_t RAOPEngine::buffered() const
 {
-	return 0;
+	ScopedLock lock(_mutex);
+
+	// nothing more will be sent once the last device is gone
+	if (_raopDevices.empty())
+	{
+		return 0;
+	}
+
+	const size_t frameSize = (RAOP_CHANNEL_COUNT * (RAOP_BITS_PER_SAMPLE / 8));
+	return static_cast<size_t>(_rtpTimeIncoming - _rtpTimeOutgoing) * frameSize;
 }
 
 
@@ -491,23 +685,71 @@ size_t RAOPEngine::canWrite() const
 {
 	ScopedLock lock(_mutex);
 
-	return (!_raopDevices.empty() && _rtpDataSecured.canWrite() ? RAOP_PACKET_MAX_DATA_SIZE : 0);
+	// limit frames queued for encoding plus packets awaiting send to packet buffer capacity
+	const uint16_t packetsInFlight = (_rtpSeqNumIncoming - _rtpSeqNumOutgoing);
+
+	return (!_raopDevices.empty() && _pcmFrames.canWrite()
+		&& packetsInFlight < _packetBufferDepth ? RAOP_PACKET_MAX_DATA_SIZE : 0);
 }
 
 
-void RAOPEngine::write(const byte_t* buffer, size_t length)
+bool RAOPEngine::waitForSpace(const long milliseconds)
 {
-	if (buffer == NULL || length == 0 || length > RAOP_PACKET_MAX_DATA_SIZE)
+	const Timestamp startTime;
+
+	// each data packet sent frees a slot, so check again after every one
+	while (canWrite() == 0)
+	{
+		const long remaining = milliseconds - static_cast<long>(startTime.elapsed() / 1000);
+		if (remaining <= 0 || !_packetSent.tryWait(remaining))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool RAOPEngine::waitUntilDrained(const long milliseconds)
+{
+	const Timestamp startTime;
+
+	for (;;)
+	{
+		{
+			ScopedLock lock(_mutex);
+
+			if (_rtpSeqNumIncoming == _rtpSeqNumOutgoing)
+			{
+				return true;
+			}
+		}
+
+		const long remaining = milliseconds - static_cast<long>(startTime.elapsed() / 1000);
+		if (remaining <= 0 || !_packetSent.tryWait(remaining))
+		{
+			return false;
+		}
+	}
+}
+
+
+void RAOPEngine::write(const byte_t* const buffer, const size_t length)
+{
+	const size_t frameSize = (RAOP_CHANNEL_COUNT * (RAOP_BITS_PER_SAMPLE / 8));
+
+	if (buffer == NULL || length == 0 || length > RAOP_PACKET_MAX_DATA_SIZE
+		|| length % frameSize != 0)
 	{
 		throw std::invalid_argument(
-			"buffer == NULL || length == 0 || length > RAOP_PACKET_MAX_DATA_SIZE");
+			"buffer == NULL || length == 0 || length > RAOP_PACKET_MAX_DATA_SIZE"
+			" || length % frameSize != 0");
 	}
 
 	ScopedLock lock(_mutex);
 
-	PacketBuffer::Slot& sslotRef = _rtpDataSecured.nextAvailable();
-	PacketBuffer::Slot& uslotRef = _rtpDataUnsecured.nextAvailable();
-	sslotRef.originalSize = uslotRef.originalSize = length;
+	FrameQueue::Slot& slotRef = _pcmFrames.nextAvailable();
 
 	DataPacketHeader packetHeader;
 	packetHeader.setMarker(_isFirstDataPacket);
@@ -516,83 +758,43 @@ void RAOPEngine::write(const byte_t* buffer, size_t length)
 	packetHeader.rtpTime = _rtpTimeIncoming;
 	packetHeader.ssrc = _rtpSsrc;
 	ByteOrder_toNetwork(packetHeader);
+	slotRef.packetHeader = packetHeader;
 
-	std::memcpy(sslotRef.packetData, &packetHeader, RTP_DATA_HEADER_SIZE);
-	std::memcpy(uslotRef.packetData, &packetHeader, RTP_DATA_HEADER_SIZE);
-	byte_t* const securedPacketPtr = &sslotRef.packetData[RTP_DATA_HEADER_SIZE];
-	byte_t* const unsecuredPacketPtr = &uslotRef.packetData[RTP_DATA_HEADER_SIZE];
-
-	std::tr1::shared_ptr<void> buf;
-	if (length < RAOP_PACKET_MAX_DATA_SIZE)
-	{
-		Debugger::printf("Recovering from %i-byte audio segment by padding it with %i bytes (%.3f ms) of silence.",
-			length, RAOP_PACKET_MAX_DATA_SIZE - length, samplesToMicroseconds((RAOP_PACKET_MAX_DATA_SIZE - length) / 4) * 0.001f);
-
-		buf.reset(std::calloc(1, RAOP_PACKET_MAX_DATA_SIZE), std::free);
-		std::memcpy(buf.get(), buffer, length);
-
-		buffer = (const byte_t*) buf.get();
-		length = RAOP_PACKET_MAX_DATA_SIZE;
-	}
-
-	// fill in unsecured packet payload with encoded audio data
-	int32_t dataLength = length;
-	_alacEncoder->Encode(ALAC_IN_FORMAT, ALAC_OUT_FORMAT, (byte_t*) buffer, unsecuredPacketPtr, &dataLength);
-	assert(dataLength > 0 && dataLength <= (RAOP_PACKET_MAX_SIZE - RTP_DATA_HEADER_SIZE)); // check for overrun
-
-	sslotRef.payloadSize = uslotRef.payloadSize = dataLength;
-	sslotRef.packetSize = uslotRef.packetSize = RTP_DATA_HEADER_SIZE + dataLength;
-	const size_t frameSize = (RAOP_CHANNEL_COUNT * (RAOP_BITS_PER_SAMPLE / 8));
-	assert((length / frameSize) <= std::numeric_limits<uint16_t>::max());
-	sslotRef.frameCount = uslotRef.frameCount = uint16_t(length / frameSize);
+	// output buffer delivers whole packets until the end of the stream, where
+	// the last one is sent with however many frames remain; ALAC marks it as a
+	// partial frame and RTP time advances by its actual length
+	std::memcpy(slotRef.frameData, buffer, length);
+	slotRef.frameSize = length;
 
-	// make copy of initialization vector because it gets modified
-	buffer_t iv(_aesIV);
-
-	// encrypt audio data into secured packet payload
-	const size_t remainderLength = uslotRef.payloadSize % AES_BLOCK_SIZE;
-	const size_t encryptLength = uslotRef.payloadSize - remainderLength;
-	AES_cbc_encrypt(
-		unsecuredPacketPtr,
-		securedPacketPtr,
-		encryptLength,
-		&_aesKey, &iv[0], AES_ENCRYPT);
-	std::memcpy(
-		securedPacketPtr + encryptLength,
-		unsecuredPacketPtr + encryptLength,
-		remainderLength);
+	_pcmFrames.commitWrite();
 
 	// increment RTP packet sequence number
 	_rtpSeqNumIncoming += 1;
 
 	// increment RTP time (one tick for each frame)
-	_rtpTimeIncoming += uslotRef.frameCount;
+	_rtpTimeIncoming += uint32_t(length / frameSize);
 
 	if (_isFirstDataPacket)
 	{
 		_isFirstDataPacket = false;
 
-		// start sending data and sync packets when first data is written
+		// start encoding and sending data and sync packets when first data is written
 		start();
 	}
-}
-
-
-	struct isClosedOrUnresponsive
+	else
 	{
-		bool operator ()(const RAOPDevice* const device)
-		{
-			return !device->isOpen();
-		}
-	};
+		// release encoder thread in case it drained the queue and is waiting;
+		// testing for emptiness here instead could race with the encoder
+		_encoderWakeup.set();
+	}
+}
 
 
 void RAOPEngine::flush()
 {
 	ScopedLock lock(_mutex);
 
-	// remove closed devices from the list
-	_raopDevices.remove_if(isClosedOrUnresponsive());
+	removeClosedDevices();
 }
 
 
@@ -604,6 +806,7 @@ void RAOPEngine::reset()
 	// test thread states
 	assert(_reactorThread.isRunning());
 	assert(!_senderThread.isRunning());
+	assert(!_encoderThread.isRunning());
 
 	ScopedLock lock(_mutex);
 
@@ -623,16 +826,17 @@ void RAOPEngine::reset()
 		CATCH_ALL
 	}
 
-	// remove closed devices from the list
-	_raopDevices.remove_if(isClosedOrUnresponsive());
+	removeClosedDevices();
 
 	// reset remaining object state
-	_firstDataTime = _lastClockSyncTime = _lastStreamSyncTime = 0;
+	_pacingBaseTime = _lastStreamSyncTime = 0;
+	_lastClockSyncTime = 0;
+	_pacingBaseSamples = 0;
 	_isFirstDataPacket = _isFirstSyncPacket = true;
 	_rtpSeqNumIncoming = _rtpSeqNumOutgoing;
 	_rtpTimeIncoming = _rtpTimeOutgoing;
-	_rtpDataUnsecured.reset();
-	_rtpDataSecured.reset();
+	_rtpData.reset();
+	_pcmFrames.reset();
 	_samplesWritten = 0;
 }
 
@@ -645,10 +849,20 @@ void RAOPEngine::attach(RAOPDevice* const raopDevice)
 		std::find(_raopDevices.begin(), _raopDevices.end(), raopDevice);
 	if (pos == _raopDevices.end())
 	{
+		raopDevice->resetStreamState();
 		_raopDevices.push_back(raopDevice);
+		watchConnection(*raopDevice);
+		updateSendTable();
+
+		if (_redundantAudio)
+		{
+			Debugger::printf("Sending redundant audio packets to %s.",
+				raopDevice->controlSocketAddr().toString().c_str());
+		}
 
 		// force a sync packet to help synchronize devices
 		_isFirstSyncPacket = true;
+		_pacingTimer.signal();
 	}
 }
 
@@ -657,7 +871,9 @@ void RAOPEngine::detach(RAOPDevice* const raopDevice)
 {
 	ScopedLockWithUnlock lock(_mutex);
 
+	unwatchConnection(*raopDevice);
 	_raopDevices.remove(raopDevice);
+	updateSendTable();
 
 	if (_raopDevices.empty())
 	{
@@ -669,9 +885,58 @@ void RAOPEngine::detach(RAOPDevice* const raopDevice)
 }
 
 
+void RAOPEngine::watchConnection(RAOPDevice& raopDevice)
+{
+	// devices stay connected until RTSP connection is seen to close or fail
+	raopDevice.setConnected(true);
+
+	_socketReactor.addEventHandler(raopDevice.connectedSocket(), _connectionReadableHandler);
+	_socketReactor.addEventHandler(raopDevice.connectedSocket(), _connectionErrorHandler);
+}
+
+
+void RAOPEngine::unwatchConnection(RAOPDevice& raopDevice)
+{
+	// device may have let go of its RTSP client already, so use socket kept
+	raopDevice.setConnected(false);
+
+	_socketReactor.removeEventHandler(raopDevice.connectedSocket(), _connectionReadableHandler);
+	_socketReactor.removeEventHandler(raopDevice.connectedSocket(), _connectionErrorHandler);
+}
+
+
+void RAOPEngine::removeClosedDevices()
+{
+	for (RAOPDeviceList::iterator it = _raopDevices.begin(); it != _raopDevices.end(); )
+	{
+		if (!(*it)->isOpen())
+		{
+			unwatchConnection(**it);
+			it = _raopDevices.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	updateSendTable();
+}
+
+
 void RAOPEngine::start()
 {
+	_latenessCount = _latenessOverOneMs = 0;
+	_latenessTotal = _latenessMax = 0;
+	_packetBufferLateCount = 0;
+	_sendCallCount = _sendDatagramCount = 0;
+	_sendTime = 0;
+	_redundantSendCount = _lostPacketCount = _lostRedundantCount = 0;
+	std::fill(_encodeCount, _encodeCount + Options::ENCODE_ADAPTIVE, 0);
+	_encodeBytesIn = _encodeBytesOut = 0;
+	_encodeTime = _encodeTimeMax = 0;
+
 	_stopSending = false;
+	_encoderThread.start(_encoderRunnable);
 	_senderThread.start(*this);
 	_senderThread.setOSPriority(THREAD_PRIORITY_ABOVE_NORMAL);
 }
@@ -680,7 +945,19 @@ void RAOPEngine::start()
 void RAOPEngine::stop()
 {
 	_stopSending = true;
+	_encoderWakeup.set();
+	_pacingTimer.signal();
+	_encoderThread.join();
 	_senderThread.join();
+
+	// release any writer waiting on packets that will no longer be sent
+	_packetSent.set();
+
+	printLateness();
+	printSendStatistics();
+	printRedundancyStatistics();
+	printEncodeStatistics();
+	_latenessCount = _sendCallCount = 0;
 }
 
 
@@ -692,123 +969,599 @@ void RAOPEngine::run()
 		{
 			ScopedLockWithUnlock lock(_mutex);
 
-			Timestamp currentTime;
+			if (_connectionClosed.exchange(false))
+			{
+				confirmClosedConnections();
+			}
+
+			const MediaClock::Time currentTime = _mediaClock.now();
 
 			// send sync packet at start of stream and periodically afterwards
-			if (_isFirstSyncPacket || (currentTime - _lastStreamSyncTime) >= 1000000L)
+			if (_isFirstSyncPacket || (currentTime - _lastStreamSyncTime) >= _syncInterval)
 			{
 				sendSyncPacket(currentTime);
 			}
 
-			// send data packet whenever system time meets or exceeds stream time
-			if (!_raopDevices.empty() && _rtpSeqNumIncoming != _rtpSeqNumOutgoing
-				&& (currentTime - _firstDataTime) >= samplesToMicroseconds(_samplesWritten))
+			MediaClock::Time deadline = _lastStreamSyncTime + _syncInterval;
+
+			if (!_raopDevices.empty() && _rtpData.canRead())
 			{
-				const size_t dataLength = sendDataPacket(currentTime);
+				// data packet is due whenever system time meets or exceeds stream time
+				const MediaClock::Time dueTime = nextDueTime();
+
+				if (currentTime >= dueTime)
+				{
+					// first packet of stream sets the clock, so it is never late
+					if (_samplesWritten > 0)
+					{
+						recordLateness((currentTime - dueTime) / MediaClock::NANOSECONDS_PER_MICROSECOND);
+					}
+
+					const PacketBuffer::Slot& slotRef = takeDataPacket(currentTime);
+
+					lock.unlock();
+
+					sendDataPacket(slotRef);
 
-				lock.unlock();
+					// notify observer of successful output
+					_outputObserver.onBytesOutput(slotRef.originalSize);
 
-				// notify observer of successful output
-				_outputObserver.onBytesOutput(dataLength);
+					continue;
+				}
+
+				deadline = std::min(deadline, dueTime);
 			}
-			else
-			{
-				// no active devices or no data to send or it's too soon to send
 
-				lock.unlock();
+			// no active devices or no data to send or it's too soon to send
 
-				Thread::sleep(1);
+			lock.unlock();
+
+			// wait for next packet deadline or for encoder or attach to signal
+			_pacingTimer.waitUntil(deadline);
+		}
+		CATCH_ALL
+	}
+}
+
+
+void RAOPEngine::encode()
+{
+	while (!_stopSending)
+	{
+		try
+		{
+			if (!_pcmFrames.canRead())
+			{
+				// wait for write or stop to signal
+				_encoderWakeup.wait();
+				continue;
 			}
+
+			encodeDataPacket(_pcmFrames.nextBuffered());
+			_pcmFrames.commitRead();
 		}
 		CATCH_ALL
 	}
 }
 
 
-size_t RAOPEngine::sendDataPacket(const Timestamp& currentTime)
+void RAOPEngine::encodeDataPacket(const FrameQueue::Slot& frameRef)
 {
-	PacketBuffer::Slot& sslotRef = _rtpDataSecured.nextBuffered();
-	PacketBuffer::Slot& uslotRef = _rtpDataUnsecured.nextBuffered();
+	// packet buffer is lock-free, so encoding runs concurrently with sending;
+	// canWrite() admits frames only while queued frames plus unsent packets
+	// stay under buffer depth, so there is always a free slot for this one
+	assert(_rtpData.canWrite());
+	PacketBuffer::Slot& slotRef = _rtpData.nextAvailable();
+
+	slotRef.originalSize = frameRef.frameSize;
+
+	std::memcpy(slotRef.packetData, &frameRef.packetHeader, RTP_DATA_HEADER_SIZE);
+	byte_t* const payloadPtr = &slotRef.packetData[RTP_DATA_HEADER_SIZE];
+
+	// fill in packet payload with encoded audio data
+	const Timestamp startTime;
+	const Options::EncoderMode encoderLevel = _encoderLevel;
+	int32_t dataLength = frameRef.frameSize;
+	if (encoderLevel == Options::ENCODE_RAW)
+	{
+		_alacEncoder->EncodeEscape(
+			const_cast<byte_t*>(frameRef.frameData), payloadPtr, &dataLength);
+	}
+	else if (encoderLevel == Options::ENCODE_FAST)
+	{
+		_alacEncoder->EncodeFast(
+			const_cast<byte_t*>(frameRef.frameData), payloadPtr, &dataLength);
+	}
+	else
+	{
+		_alacEncoder->SetFastMode(false);
+		_alacEncoder->Encode(ALAC_IN_FORMAT, ALAC_OUT_FORMAT,
+			const_cast<byte_t*>(frameRef.frameData), payloadPtr, &dataLength);
+	}
+	assert(dataLength > 0 && dataLength <= (RAOP_PACKET_MAX_SIZE - RTP_DATA_HEADER_SIZE)); // check for overrun
 
-	const DataPacketHeader& packetHeader =
-		*reinterpret_cast<DataPacketHeader*>(sslotRef.packetData);
+	const Timestamp::TimeDiff encodeTime = startTime.elapsed();
+	_encodeCount[encoderLevel] += 1;
+	_encodeBytesIn += frameRef.frameSize;
+	_encodeBytesOut += dataLength;
+	_encodeTime += encodeTime;
+	_encodeTimeMax = std::max(_encodeTimeMax, encodeTime);
+
+	if (_encoderMode == Options::ENCODE_ADAPTIVE)
+	{
+		adaptEncoderLevel(encodeTime);
+	}
+
+	slotRef.payloadSize = dataLength;
+	slotRef.packetSize = RTP_DATA_HEADER_SIZE + dataLength;
+	const size_t frameSize = (RAOP_CHANNEL_COUNT * (RAOP_BITS_PER_SAMPLE / 8));
+	assert((frameRef.frameSize / frameSize) <= std::numeric_limits<uint16_t>::max());
+	slotRef.frameCount = uint16_t(frameRef.frameSize / frameSize);
+
+	// encrypt payload in place only if that is the variant devices want
+	slotRef.secured = _secureDataStream;
+	if (slotRef.secured)
+	{
+		// make copy of initialization vector because it gets modified
+		byte_t iv[AES_BLOCK_SIZE];
+		std::memcpy(iv, &_aesIV[0], AES_BLOCK_SIZE);
 
-	// send data packet to each device
+		// trailing partial block is left unencrypted
+		const size_t encryptLength = slotRef.payloadSize - (slotRef.payloadSize % AES_BLOCK_SIZE);
+		AES_cbc_encrypt(payloadPtr, payloadPtr, encryptLength, &_aesKey, iv, AES_ENCRYPT);
+	}
+
+	// publish packet to sender thread
+	_rtpData.commitWrite();
+
+	// release sender thread in case it is waiting on an empty buffer
+	_pacingTimer.signal();
+}
+
+
+void RAOPEngine::adaptEncoderLevel(const Timestamp::TimeDiff encodeTime)
+{
+	// running mean over roughly the last 16 packets encoded in current mode
+	Timestamp::TimeDiff& average = _encodeTimeAverage[_encoderLevel];
+	average += (encodeTime - average) / 16;
+
+	if (++_adaptivePacketCount < ADAPTIVE_INTERVAL)
+	{
+		return;
+	}
+	_adaptivePacketCount = 0;
+
+	// late data packets mean the sender or network is struggling, and raw
+	// frames would roughly double the bandwidth needed
+	const uint32_t lateCount = _latenessOverOneMs;
+	const bool senderLagging = (lateCount != _adaptiveLateCount);
+	_adaptiveLateCount = lateCount;
+
+	// use the most compact mode that has fit within the time limit; modes
+	// left for being too slow have their means decayed so they get retried
+	Options::EncoderMode level = Options::ENCODE_FULL;
+	while (level < Options::ENCODE_RAW && _encodeTimeAverage[level] > ENCODE_TIME_LIMIT)
+	{
+		_encodeTimeAverage[level] /= 2;
+		level = Options::EncoderMode(level + 1);
+	}
+	if (level == Options::ENCODE_RAW && senderLagging)
+	{
+		level = Options::ENCODE_FAST;
+	}
+
+	if (level != _encoderLevel)
+	{
+		Debugger::printf("Adaptive encoding switched from mode %d to %d "
+			"(mean encode time %.3f ms).", (int) _encoderLevel, (int) level,
+			static_cast<double>(average) / 1000.0);
+		_encoderLevel = level;
+	}
+}
+
+
+void RAOPEngine::convertDataPacket(const PacketBuffer::Slot& slotRef, byte_t* const packetData) const
+{
+	assert(slotRef.packetSize <= RAOP_PACKET_MAX_SIZE);
+
+	std::memcpy(packetData, slotRef.packetData, RTP_DATA_HEADER_SIZE);
+	const byte_t* const sourcePayloadPtr = &slotRef.packetData[RTP_DATA_HEADER_SIZE];
+	byte_t* const targetPayloadPtr = &packetData[RTP_DATA_HEADER_SIZE];
+
+	// make copy of initialization vector because it gets modified
+	byte_t iv[AES_BLOCK_SIZE];
+	std::memcpy(iv, &_aesIV[0], AES_BLOCK_SIZE);
+
+	// decrypt secured payload or encrypt unsecured payload
+	const size_t remainderLength = slotRef.payloadSize % AES_BLOCK_SIZE;
+	const size_t cryptLength = slotRef.payloadSize - remainderLength;
+	AES_cbc_encrypt(
+		sourcePayloadPtr,
+		targetPayloadPtr,
+		cryptLength,
+		slotRef.secured ? &_aesDecryptKey : &_aesKey,
+		iv, slotRef.secured ? AES_DECRYPT : AES_ENCRYPT);
+	std::memcpy(
+		targetPayloadPtr + cryptLength,
+		sourcePayloadPtr + cryptLength,
+		remainderLength);
+}
+
+
+void RAOPEngine::updateSendTable()
+{
+	// build a new table rather than change the one sender may be reading
+	std::shared_ptr<SendTable> sendTable(new SendTable);
 	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
 		it != _raopDevices.end(); ++it)
 	{
-		RAOPDevice& raopDevice = **it;
+		const RAOPDevice& raopDevice = **it;
 
-		try
+		if (raopDevice.isConnected())
 		{
-			if (raopDevice.isOpen())
+			(raopDevice.secureDataStream() ? sendTable->securedAudio : sendTable->unsecuredAudio)
+				.push_back(raopDevice.audioSocketAddr());
+			sendTable->control.push_back(raopDevice.controlSocketAddr());
+
+			if (_redundantAudio)
 			{
-				sendTo(_dataSocket,
-					raopDevice.audioSocketAddr(),
-					raopDevice.secureDataStream()
-						? sslotRef.packetData
-						: uslotRef.packetData,
-					sslotRef.packetSize);
+				(raopDevice.secureDataStream() ? sendTable->securedRedundant : sendTable->unsecuredRedundant)
+					.push_back(raopDevice.controlSocketAddr());
 			}
 		}
+	}
+
+	// encrypt up front only when no device would need packets decrypted again;
+	// mixed sets store unsecured packets and encrypt them while sending
+	_secureDataStream = (!sendTable->securedAudio.empty() && sendTable->unsecuredAudio.empty());
+
+	std::atomic_store(&_sendTable, std::shared_ptr<const SendTable>(sendTable));
+}
+
+
+void RAOPEngine::adaptPacketBuffer()
+{
+	// gather resend activity of each device since last time
+	uint32_t resendCount = 0;
+	uint16_t resendAge = 0;
+	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
+		it != _raopDevices.end(); ++it)
+	{
+		uint32_t count;
+		uint16_t ageMax;
+		(*it)->takeResendRequests(count, ageMax);
+
+		resendCount += count;
+		resendAge = std::max(resendAge, ageMax);
+	}
+
+	const uint32_t lateCount = _latenessOverOneMs;
+	const bool senderLagging = (lateCount != _packetBufferLateCount);
+	_packetBufferLateCount = lateCount;
+
+	// history must reach back past the oldest packet any device asked for,
+	// which is the round trip plus however long it took to notice the loss;
+	// grow to that at once, with room to spare, and give it back gradually
+	const uint16_t tailLength = _rtpData.tailLength();
+	const uint16_t tailTarget = static_cast<uint16_t>(std::min<uint32_t>(PACKET_MEMORY_COUNT,
+		std::max<uint32_t>(PACKET_MEMORY_MIN_COUNT, resendAge * 2u)));
+	_rtpData.setTailLength(tailTarget > tailLength
+		? tailTarget : tailLength - (tailLength - tailTarget) / 8);
+
+	// lost or late packets call for more audio queued ahead of the sender;
+	// a clean interval lets the queue, and with it latency, shrink again
+	const uint16_t depth = _packetBufferDepth;
+	if (resendCount > 0 || senderLagging)
+	{
+		_packetBufferDepth = std::min<uint16_t>(_packetBufferMax, depth * 2);
+	}
+	else
+	{
+		_packetBufferDepth = std::max<uint16_t>(_packetBufferMin, depth - depth / 16);
+	}
+
+	if (_packetBufferDepth > depth || _rtpData.tailLength() > tailLength)
+	{
+		Debugger::printf("Packet buffer grew to %hu queued and %hu retained packets "
+			"after %u resend request(s) reaching back %hu packets.",
+			_packetBufferDepth, _rtpData.tailLength(), resendCount, resendAge);
+	}
+}
+
+
+MediaClock::Time RAOPEngine::nextDueTime() const
+{
+	const double elapsed = static_cast<double>(
+		samplesToMediaTime(_samplesWritten - _pacingBaseSamples));
+
+	return _pacingBaseTime + static_cast<MediaClock::Time>(elapsed / _driftRatio);
+}
+
+
+void RAOPEngine::updateDriftRatio()
+{
+	// rebase stream clock at most once per sync interval
+	const MediaClock::Time currentTime = _mediaClock.now();
+	if (_driftRatioTime != 0 && currentTime - _driftRatioTime < _syncInterval)
+	{
+		return;
+	}
+
+	std::vector<double> skews;
+	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
+		it != _raopDevices.end(); ++it)
+	{
+		const RAOPDevice& raopDevice = **it;
+
+		if (raopDevice.isConnected() && raopDevice.clockDrift().isValid())
+		{
+			skews.push_back(raopDevice.clockDrift().skew());
+		}
+	}
+	if (skews.empty())
+	{
+		return;
+	}
+
+	// one stream serves every device, so follow the middle of their clocks
+	std::vector<double>::iterator median = skews.begin() + skews.size() / 2;
+	std::nth_element(skews.begin(), median, skews.end());
+	const double driftRatio = 1.0 + std::min(std::max(*median, -DRIFT_MAX), DRIFT_MAX);
+	if (std::abs(driftRatio - _driftRatio) < DRIFT_HYSTERESIS)
+	{
+		return;
+	}
+
+	if (std::abs(driftRatio - _driftRatio) * 1000000.0 >= 5.0)
+	{
+		Debugger::printf("Pacing stream at %+.1f ppm to follow device clocks.",
+			(driftRatio - 1.0) * 1000000.0);
+	}
+
+	// rebase stream clock so packets already sent keep their due times
+	if (_samplesWritten > 0)
+	{
+		_pacingBaseTime = nextDueTime();
+		_pacingBaseSamples = _samplesWritten;
+	}
+	_driftRatio = driftRatio;
+	_driftRatioTime = currentTime;
+}
+
+
+void RAOPEngine::recordLateness(const Timestamp::TimeDiff lateness)
+{
+	_latenessCount += 1;
+	_latenessTotal += lateness;
+	_latenessMax = std::max(_latenessMax, lateness);
+
+	if (lateness > 1000)
+	{
+		_latenessOverOneMs += 1;
+	}
+}
+
+
+void RAOPEngine::printLateness() const
+{
+	if (_latenessCount > 0)
+	{
+		Debugger::printf("Data packet lateness over %u packets: "
+			"mean = %.3f ms; max = %.3f ms; %u packet(s) more than 1 ms late.",
+			_latenessCount,
+			static_cast<double>(_latenessTotal) / _latenessCount / 1000.0,
+			static_cast<double>(_latenessMax) / 1000.0,
+			_latenessOverOneMs);
+	}
+}
+
+
+void RAOPEngine::printSendStatistics() const
+{
+	if (_sendCallCount > 0)
+	{
+		Debugger::printf("Sent %u datagram(s) in %u batched call(s): "
+			"%.2f datagrams per call; %.3f us per call.",
+			_sendDatagramCount, _sendCallCount,
+			static_cast<double>(_sendDatagramCount) / _sendCallCount,
+			static_cast<double>(_sendTime) / _sendCallCount);
+	}
+}
+
+
+void RAOPEngine::printRedundancyStatistics() const
+{
+	if (_redundantSendCount > 0 || _lostPacketCount > 0)
+	{
+		Debugger::printf("Sent %u redundant packet(s); devices asked for %u lost "
+			"packet(s), %u of them despite a copy.",
+			_redundantSendCount, _lostPacketCount, _lostRedundantCount);
+	}
+}
+
+
+void RAOPEngine::printEncodeStatistics() const
+{
+	const uint32_t encodeCount = _encodeCount[Options::ENCODE_FULL]
+		+ _encodeCount[Options::ENCODE_FAST] + _encodeCount[Options::ENCODE_RAW];
+	if (encodeCount > 0)
+	{
+		Debugger::printf("Encoded %u packet(s) (%u full, %u fast, %u raw): "
+			"%.1f KB in, %.1f KB out (%.1f%%); mean = %.3f ms; max = %.3f ms.",
+			encodeCount, _encodeCount[Options::ENCODE_FULL],
+			_encodeCount[Options::ENCODE_FAST], _encodeCount[Options::ENCODE_RAW],
+			static_cast<double>(_encodeBytesIn) / 1024.0,
+			static_cast<double>(_encodeBytesOut) / 1024.0,
+			static_cast<double>(_encodeBytesOut) * 100.0 / _encodeBytesIn,
+			static_cast<double>(_encodeTime) / encodeCount / 1000.0,
+			static_cast<double>(_encodeTimeMax) / 1000.0);
+	}
+}
+
+
+void RAOPEngine::sendToEach(DatagramSocket& socket, const SocketAddressList& addresses,
+	const void* const buffer, const size_t length, const char* const packetKind)
+{
+	if (addresses.empty())
+	{
+		return;
+	}
+
+	size_t sent = 0;
+	try
+	{
+		const Timestamp startTime;
+
+		// fan out to all destinations with as few system calls as possible
+		sent = static_cast<size_t>(socket.sendToMany(buffer, static_cast<int>(length),
+			&addresses[0], static_cast<int>(addresses.size())));
+
+		_sendCallCount += 1;
+		_sendDatagramCount += sent;
+		_sendTime += startTime.elapsed();
+	}
+	catch (const std::exception&)
+	{
+		// retry individually below to report which destination failed
+	}
+
+	for (; sent < addresses.size(); ++sent)
+	{
+		try
+		{
+			sendTo(socket, addresses[sent], buffer, length);
+		}
 		catch (const std::exception& ex)
 		{
 			Debugger::printException(ex, Poco::format(
-				"Sending data packet %hu to %s",
-				ByteOrder::fromNetwork(packetHeader.seqNum),
-				raopDevice.audioSocketAddr().toString()));
+				"Sending %s to %s", std::string(packetKind),
+				addresses[sent].toString()));
 		}
 	}
+}
+
+
+const PacketBuffer::Slot& RAOPEngine::takeDataPacket(const MediaClock::Time currentTime)
+{
+	// slot moves into history, where writer cannot reuse it before it is sent
+	const PacketBuffer::Slot& slotRef = _rtpData.nextBuffered();
+
+	const DataPacketHeader& packetHeader =
+		*reinterpret_cast<const DataPacketHeader*>(slotRef.packetData);
 
 	// check for indicator of first data packet in stream
 	if (packetHeader.getMarker())
 	{
-		_firstDataTime = currentTime;
+		_pacingBaseTime = currentTime;
+		_pacingBaseSamples = _samplesWritten;
 	}
 
 	// update counters
 	_rtpSeqNumOutgoing += 1;
-	_rtpTimeOutgoing += sslotRef.frameCount;
-	_samplesWritten += sslotRef.frameCount;
+	_rtpTimeOutgoing += slotRef.frameCount;
+	_samplesWritten += slotRef.frameCount;
+
+	if (_rtpSeqNumOutgoing % PACKET_BUFFER_INTERVAL == 0)
+	{
+		adaptPacketBuffer();
+	}
 
-	return sslotRef.originalSize;
+	return slotRef;
 }
 
 
-void RAOPEngine::sendSyncPacket(const Timestamp& currentTime)
+void RAOPEngine::sendDataPacket(const PacketBuffer::Slot& slotRef)
+{
+	const std::shared_ptr<const SendTable> sendTable(std::atomic_load(&_sendTable));
+
+	const SocketAddressList& sameTargets =
+		(slotRef.secured ? sendTable->securedAudio : sendTable->unsecuredAudio);
+	const SocketAddressList& convertedTargets =
+		(slotRef.secured ? sendTable->unsecuredAudio : sendTable->securedAudio);
+
+	// send data packet to each device, producing other stream variant only if needed
+	sendToEach(_dataSocket, sameTargets, slotRef.packetData, slotRef.packetSize, "data packet");
+	if (!convertedTargets.empty())
+	{
+		convertDataPacket(slotRef, &_convertedPacket[0]);
+		sendToEach(_dataSocket, convertedTargets, &_convertedPacket[0], slotRef.packetSize, "data packet");
+	}
+
+	if (!sendTable->securedRedundant.empty() || !sendTable->unsecuredRedundant.empty())
+	{
+		sendRedundantPacket(slotRef, *sendTable);
+	}
+
+	// release writer waiting for room in packet buffer or for it to drain
+	_packetSent.set();
+}
+
+
+void RAOPEngine::sendRedundantPacket(const PacketBuffer::Slot& slotRef, const SendTable& sendTable)
+{
+	// packet just sent is newest in history; its copy goes out that many later
+	if (_rtpData.tailLength() <= REDUNDANT_PACKET_OFFSET)
+	{
+		return;
+	}
+	const PacketBuffer::Slot& copyRef = _rtpData.prevBuffered(REDUNDANT_PACKET_OFFSET + 1);
+
+	// skip copy until history reaches back that far into current stream
+	const uint16_t seqNum = ByteOrder::fromNetwork(
+		reinterpret_cast<const DataPacketHeader*>(slotRef.packetData)->seqNum);
+	const uint16_t copySeqNum = ByteOrder::fromNetwork(
+		reinterpret_cast<const DataPacketHeader*>(copyRef.packetData)->seqNum);
+	if (copySeqNum != static_cast<uint16_t>(seqNum - REDUNDANT_PACKET_OFFSET))
+	{
+		return;
+	}
+
+	// devices place a resend by the sequence number of the packet inside and
+	// drop one they already have, so copy goes out wrapped as a resend response
+	RTPPacketHeader header;  header.setMarker();
+	header.setPayloadType(PAYLOAD_TYPE_RESEND_RESPONSE);
+	header.seqNum = ByteOrder::toNetwork(copyRef.frameCount);
+	std::memcpy(&_redundantPacket[0], &header, RTP_BASE_HEADER_SIZE);
+
+	const size_t packetSize = std::min(copyRef.packetSize, RAOP_PACKET_MAX_SIZE);
+
+	const SocketAddressList& sameTargets =
+		(copyRef.secured ? sendTable.securedRedundant : sendTable.unsecuredRedundant);
+	const SocketAddressList& convertedTargets =
+		(copyRef.secured ? sendTable.unsecuredRedundant : sendTable.securedRedundant);
+
+	if (!sameTargets.empty())
+	{
+		std::memcpy(&_redundantPacket[RTP_BASE_HEADER_SIZE], copyRef.packetData, packetSize);
+		sendToEach(_controlSocket, sameTargets,
+			&_redundantPacket[0], RTP_BASE_HEADER_SIZE + packetSize, "redundant packet");
+	}
+	if (!convertedTargets.empty())
+	{
+		convertDataPacket(copyRef, &_redundantPacket[RTP_BASE_HEADER_SIZE]);
+		sendToEach(_controlSocket, convertedTargets,
+			&_redundantPacket[0], RTP_BASE_HEADER_SIZE + packetSize, "redundant packet");
+	}
+
+	_redundantSendCount += static_cast<uint32_t>(sameTargets.size() + convertedTargets.size());
+}
+
+
+void RAOPEngine::sendSyncPacket(const MediaClock::Time currentTime)
 {
 	SyncPacket syncPacket;
 	syncPacket.setMarker();
 	syncPacket.setExtension(_isFirstSyncPacket);
 	syncPacket.setPayloadType(PAYLOAD_TYPE_STREAM_SYNC);
 	syncPacket.seqNum = 7;
-	syncPacket.ntpTime = currentTime;
+	syncPacket.ntpTime = _mediaClock.toNTPTimestamp(currentTime);
 	syncPacket.rtpTime = _rtpTimeOutgoing;
-	syncPacket.rtpTimeLessLatency = (_rtpTimeOutgoing - 77175);
+	syncPacket.rtpTimeLessLatency = (_rtpTimeOutgoing - _syncLatency);
 	ByteOrder_toNetwork(syncPacket);
 
 	// send sync packet to each device
-	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
-		it != _raopDevices.end(); ++it)
-	{
-		RAOPDevice& raopDevice = **it;
-
-		try
-		{
-			if (raopDevice.isOpen())
-			{
-				sendTo(_controlSocket,
-					raopDevice.controlSocketAddr(),
-					&syncPacket, RTP_SYNC_PACKET_SIZE);
-			}
-		}
-		catch (const std::exception& ex)
-		{
-			Debugger::printException(ex, Poco::format(
-				"Sending sync packet to %s",
-				raopDevice.controlSocketAddr().toString()));
-		}
-	}
+	const std::shared_ptr<const SendTable> sendTable(std::atomic_load(&_sendTable));
+	sendToEach(_controlSocket, sendTable->control, &syncPacket, RTP_SYNC_PACKET_SIZE, "sync packet");
 
 	_isFirstSyncPacket = false;
 	_lastStreamSyncTime = currentTime;
@@ -843,7 +1596,7 @@ void RAOPEngine::handleTimingRequest(ReadableNotification*)
 			ByteOrder_fromNetwork(request);
 
 			// capture current time for response
-			Timestamp currentTime;
+			const Timestamp currentTime = _mediaClock.toTimestamp(_mediaClock.now());
 
 			TimingPacket response(request);
 			response.setPayloadType(PAYLOAD_TYPE_TIMING_RESPONSE);
@@ -854,6 +1607,25 @@ void RAOPEngine::handleTimingRequest(ReadableNotification*)
 
 			sendTo(_timingSocket, sender, &response, RTP_TIMING_PACKET_SIZE);
 
+			// each request tells when requestor sent it by its own clock
+			{
+				ScopedLock lock(_mutex);
+
+				for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
+					it != _raopDevices.end(); ++it)
+				{
+					RAOPDevice& raopDevice = **it;
+
+					// devices send timing requests from port they gave for them
+					if (raopDevice.timingSocketAddr() == sender)
+					{
+						raopDevice.clockDrift().addSample(currentTime, request.sendTime);
+						updateDriftRatio();
+						break;
+					}
+				}
+			}
+
 			// gather and examine timing metrics
 			if (_lastClockSyncTime != 0)
 			{
@@ -937,13 +1709,6 @@ void RAOPEngine::handleResendRequest(ResendRequestPacket& request,
 		? _rtpSeqNumOutgoing - request.missedSeqNum
 		: _rtpSeqNumOutgoing + (std::numeric_limits<uint16_t>::max() - request.missedSeqNum) + 1);
 
-	if (missedPktAge < 1 || missedPktAge > PACKET_MEMORY_COUNT)
-	{
-		Debugger::printf("Requested packet(s) too old to resend; "
-			"only the last %hu sent packets are kept.", PACKET_MEMORY_COUNT);
-		return;
-	}
-
 	// determine which device is the requestor
 	RAOPDevice* requestor = NULL;
 	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
@@ -967,16 +1732,31 @@ void RAOPEngine::handleResendRequest(ResendRequestPacket& request,
 			requestorAddress.toString().c_str());
 		return;
 	}
-	else if (!requestor->isOpen())
+	else if (!requestor->isConnected())
 	{
 		Debugger::printf("Requestor %s no longer open for playback.",
 			requestorAddress.toString().c_str());
 		return;
 	}
 
-	// obtain reference to correct packet stream for requesting device
-	const PacketBuffer& rtpData =
-		(requestor->secureDataStream() ? _rtpDataSecured : _rtpDataUnsecured);
+	// note how far back device reached so history can be sized to match
+	requestor->countResendRequest(missedPktAge);
+
+	// packets older than redundancy offset had their copy sent already, so
+	// losing them means both copies went missing
+	_lostPacketCount += request.missedPktCnt;
+	if (_redundantAudio && missedPktAge > REDUNDANT_PACKET_OFFSET)
+	{
+		_lostRedundantCount += std::min<uint32_t>(request.missedPktCnt,
+			missedPktAge - REDUNDANT_PACKET_OFFSET);
+	}
+
+	if (missedPktAge < 1 || missedPktAge > _rtpData.tailLength())
+	{
+		Debugger::printf("Requested packet(s) too old to resend; "
+			"only the last %hu sent packets are kept.", _rtpData.tailLength());
+		return;
+	}
 
 	RTPPacketHeader header;  header.setMarker();
 	header.setPayloadType(PAYLOAD_TYPE_RESEND_RESPONSE);
@@ -984,7 +1764,7 @@ void RAOPEngine::handleResendRequest(ResendRequestPacket& request,
 
 	while (request.missedPktCnt > 0)
 	{
-		const PacketBuffer::Slot& slotRef = rtpData.prevBuffered(missedPktAge);
+		const PacketBuffer::Slot& slotRef = _rtpData.prevBuffered(missedPktAge);
 
 		const uint16_t dataPacketSeqNum = ByteOrder::fromNetwork(
 			reinterpret_cast<const DataPacketHeader*>(slotRef.packetData)->seqNum);
@@ -1001,7 +1781,15 @@ void RAOPEngine::handleResendRequest(ResendRequestPacket& request,
 
 		std::memcpy(&response[0], &header, RTP_BASE_HEADER_SIZE);
 		const size_t packetSize = std::min(slotRef.packetSize, RAOP_PACKET_MAX_SIZE);
-		std::memcpy(&response[RTP_BASE_HEADER_SIZE], slotRef.packetData, packetSize);
+		if (requestor->secureDataStream() == slotRef.secured)
+		{
+			std::memcpy(&response[RTP_BASE_HEADER_SIZE], slotRef.packetData, packetSize);
+		}
+		else
+		{
+			// produce stream variant requestor expects
+			convertDataPacket(slotRef, &response[RTP_BASE_HEADER_SIZE]);
+		}
 
 		sendTo(_controlSocket, requestorAddress, &response[0], RTP_BASE_HEADER_SIZE + packetSize);
 
@@ -1011,3 +1799,129 @@ void RAOPEngine::handleResendRequest(ResendRequestPacket& request,
 		request.missedSeqNum += 1;
 	}
 }
+
+
+void RAOPEngine::handleConnectionReadable(ReadableNotification* notification)
+{
+	// RTSP connection turns readable when a response arrives for a request
+	// in progress, and when the device closes or resets it
+	checkConnection(notification->socket());
+}
+
+
+void RAOPEngine::handleConnectionError(ErrorNotification* notification)
+{
+	checkConnection(notification->socket());
+}
+
+
+void RAOPEngine::handleReactorTimeout(TimeoutNotification*)
+{
+	if (_pendingResponses.empty())
+	{
+		return;
+	}
+
+	// timeout handler is never removed, so it may take engine's mutex
+	ScopedLock lock(_mutex);
+
+	// resume watching connections that had data waiting to be read
+	for (std::map<Socket, PendingResponse>::const_iterator pos = _pendingResponses.begin();
+		pos != _pendingResponses.end(); ++pos)
+	{
+		if (!pos->second.paused)
+		{
+			continue;
+		}
+
+		for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
+			it != _raopDevices.end(); ++it)
+		{
+			if ((*it)->isConnected() && (*it)->connectedSocket() == pos->first)
+			{
+				_socketReactor.addEventHandler(pos->first, _connectionReadableHandler);
+				break;
+			}
+		}
+	}
+	_pendingResponses.clear();
+}
+
+
+void RAOPEngine::checkConnection(const Socket& socket)
+{
+	if (isConnectionClosed(socket))
+	{
+		// stop watching at once so reactor does not spin on closed connection,
+		// and leave it to sender to find out which device it was
+		_socketReactor.removeEventHandler(socket, _connectionReadableHandler);
+		_socketReactor.removeEventHandler(socket, _connectionErrorHandler);
+		_pendingResponses.erase(socket);
+
+		{
+			Poco::FastMutex::ScopedLock lock(_closedConnectionsMutex);
+			_closedConnections.push_back(socket);
+		}
+		_connectionClosed = true;
+		_pacingTimer.signal();
+		return;
+	}
+
+	// data is waiting for the request in progress to read it; give it time
+	// to, then stop watching until the reactor's next timeout so as not to
+	// keep the reactor busy
+	std::map<Socket, PendingResponse>::iterator pos = _pendingResponses.find(socket);
+	if (pos == _pendingResponses.end()
+		|| (!pos->second.paused && pos->second.since.isElapsed(RTSP_RESPONSE_WINDOW)))
+	{
+		PendingResponse& pendingResponse = _pendingResponses[socket];
+		pendingResponse.since.update();
+		pendingResponse.paused = false;
+		Thread::yield();
+	}
+	else if (pos->second.since.isElapsed(RTSP_RESPONSE_GRACE))
+	{
+		_socketReactor.removeEventHandler(socket, _connectionReadableHandler);
+		pos->second.paused = true;
+	}
+	else
+	{
+		Thread::yield();
+	}
+}
+
+
+void RAOPEngine::confirmClosedConnections()
+{
+	std::vector<Socket> closedConnections;
+	{
+		Poco::FastMutex::ScopedLock lock(_closedConnectionsMutex);
+		closedConnections.swap(_closedConnections);
+	}
+
+	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
+		it != _raopDevices.end(); ++it)
+	{
+		RAOPDevice& raopDevice = **it;
+
+		if (!raopDevice.isConnected() || std::find(closedConnections.begin(),
+			closedConnections.end(), raopDevice.connectedSocket()) == closedConnections.end())
+		{
+			continue;
+		}
+
+		if (!raopDevice.isOpen())
+		{
+			Debugger::printf("RTSP connection to %s closed; no longer sending to it.",
+				raopDevice.audioSocketAddr().toString().c_str());
+
+			unwatchConnection(raopDevice);
+		}
+		else
+		{
+			// reactor mistook a response read as it looked for closure
+			watchConnection(raopDevice);
+		}
+	}
+	updateSendTable();
+}
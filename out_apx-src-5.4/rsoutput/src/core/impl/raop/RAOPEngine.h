@@ -18,7 +18,11 @@
 #define RAOPEngine_h
 
 
+#include "FrameQueue.h"
+#include "MediaClock.h"
+#include "Options.h"
 #include "OutputFormat.h"
+#include "PacingTimer.h"
 #include "PacketBuffer.h"
 #include "Platform.h"
 #include "RAOPDefs.h"
@@ -26,13 +30,18 @@
 #include "Uncopyable.h"
 #include "impl/OutputObserver.h"
 #include "impl/OutputSink.h"
+#include <atomic>
 #include <list>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 #include <openssl/aes.h>
 #include <openssl/rsa.h>
+#include <Poco/Event.h>
 #include <Poco/Mutex.h>
 #include <Poco/Runnable.h>
+#include <Poco/RunnableAdapter.h>
 #include <Poco/ScopedLock.h>
 #include <Poco/Thread.h>
 #include <Poco/Timestamp.h>
@@ -54,7 +63,7 @@ public:
 	static const OutputFormat& outputFormat();
 
 private:
-	static int64_t samplesToMicroseconds(int64_t);
+	static MediaClock::Time samplesToMediaTime(int64_t);
 	static int32_t samplesToMilliseconds(int64_t);
 
 public:
@@ -77,6 +86,9 @@ public:
 	void flush();
 	void reset();
 
+	bool waitForSpace(long milliseconds);
+	bool waitUntilDrained(long milliseconds);
+
 private:
 	void attach(class RAOPDevice*);
 	void detach(class RAOPDevice*);
@@ -84,11 +96,49 @@ private:
 	void start();
 	void stop();
 	void run();
-
-	size_t sendDataPacket(const Poco::Timestamp&);
-	void sendSyncPacket(const Poco::Timestamp&);
+	void encode();
+
+	void encodeDataPacket(const FrameQueue::Slot&);
+	void adaptEncoderLevel(Poco::Timestamp::TimeDiff);
+	void printEncodeStatistics() const;
+	void convertDataPacket(const PacketBuffer::Slot&, byte_t*) const;
+	void updateSendTable();
+	void adaptPacketBuffer();
+	void updateDriftRatio();
+	MediaClock::Time nextDueTime() const;
+	void recordLateness(Poco::Timestamp::TimeDiff);
+	void printLateness() const;
+	void printSendStatistics() const;
+	void printRedundancyStatistics() const;
+
+	typedef std::vector<Poco::Net::SocketAddress> SocketAddressList;
+	void sendToEach(Poco::Net::DatagramSocket&, const SocketAddressList&,
+		const void*, size_t, const char* packetKind);
+
+	// destinations of connected devices, grouped as the sender fans out
+	struct SendTable
+	{
+		SocketAddressList securedAudio;   // devices taking encrypted stream
+		SocketAddressList unsecuredAudio; // devices taking unencrypted stream
+		SocketAddressList control;        // for sync packets
+		SocketAddressList securedRedundant;   // control ports of devices taking
+		SocketAddressList unsecuredRedundant; // redundant packets, by variant
+	};
+
+	const PacketBuffer::Slot& takeDataPacket(MediaClock::Time);
+	void sendDataPacket(const PacketBuffer::Slot&); // without holding lock
+	void sendRedundantPacket(const PacketBuffer::Slot&, const SendTable&);
+	void sendSyncPacket(MediaClock::Time);
 	void handleTimingRequest(Poco::Net::ReadableNotification*);
 	void handleControlRequest(Poco::Net::ReadableNotification*);
+	void handleConnectionReadable(Poco::Net::ReadableNotification*);
+	void handleConnectionError(Poco::Net::ErrorNotification*);
+	void handleReactorTimeout(Poco::Net::TimeoutNotification*);
+	void checkConnection(const Poco::Net::Socket&); // on reactor thread
+	void confirmClosedConnections();
+	void watchConnection(class RAOPDevice&);
+	void unwatchConnection(class RAOPDevice&);
+	void removeClosedDevices();
 	void handleResendRequest(ResendRequestPacket&, const Poco::Net::SocketAddress&);
 
 private:
@@ -98,18 +148,47 @@ private:
 
 	/** AES encryption key (binary and base64-encoded) */
 	AES_KEY _aesKey;
+	AES_KEY _aesDecryptKey;
 	std::string _encodedKey;
 
 	/** AES encryption initialization vector (binary and base64-encoded) */
 	buffer_t _aesIV;
 	std::string _encodedIV;
 
-	/** RTP audio latency (in number of samples per channel) */
+	/** audio latency assumed for devices that report none (in number of samples per channel) */
 	unsigned int _audioLatency;
 
-	/** RTP audio data packets */
-	PacketBuffer _rtpDataSecured;
-	PacketBuffer _rtpDataUnsecured;
+	/** raw audio frames awaiting encoding */
+	FrameQueue _pcmFrames;
+
+	/** RTP audio data packets, each stored secured or unsecured */
+	PacketBuffer _rtpData;
+	buffer_t _convertedPacket;
+
+	/** packets allowed in flight, as sized by adaptPacketBuffer() */
+	uint16_t _packetBufferDepth;
+	uint32_t _packetBufferLateCount;
+
+	/** latency profile: bounds of packet buffer depth, samples between
+	    sending and playing a frame, and time between sync packets */
+	uint16_t _packetBufferMax;
+	uint16_t _packetBufferMin;
+	uint32_t _syncLatency;
+	MediaClock::Time _syncInterval;
+
+	/** redundant audio, when opted into: every device gets each data packet
+	    again, a fixed number of packets later, as an unrequested resend */
+	bool _redundantAudio;
+	buffer_t _redundantPacket;
+
+	/** redundant copies sent, packets devices asked to have resent, and how
+	    many of those were lost even though a copy had been sent */
+	uint32_t _redundantSendCount;
+	uint32_t _lostPacketCount;
+	uint32_t _lostRedundantCount;
+
+	/** stream variant to encode into, as determined by attached devices */
+	volatile bool _secureDataStream;
 
 	/** RTP packet sequence number */
 	uint16_t _rtpSeqNumIncoming;
@@ -127,17 +206,79 @@ private:
 
 	bool _isFirstDataPacket;
 	bool _isFirstSyncPacket;
-	Poco::Timestamp _firstDataTime;
 	Poco::Timestamp _lastClockSyncTime;
-	Poco::Timestamp _lastStreamSyncTime;
+	MediaClock::Time _lastStreamSyncTime;
+
+	/** stream clock: packets are paced from a base time and sample count, at
+	    a rate scaled to follow device clocks, and rebased when rate changes */
+	MediaClock::Time _pacingBaseTime;
+	int64_t _pacingBaseSamples;
+	double _driftRatio;
+	MediaClock::Time _driftRatioTime; // when rate last changed
+
+	/** data packet release lateness relative to RTP clock (in microseconds) */
+	uint32_t _latenessCount;
+	volatile uint32_t _latenessOverOneMs; // also read by encoder thread
+	Poco::Timestamp::TimeDiff _latenessTotal;
+	Poco::Timestamp::TimeDiff _latenessMax;
+
+	/** batched send activity (calls, datagrams and time spent sending) */
+	uint32_t _sendCallCount;
+	uint32_t _sendDatagramCount;
+	Poco::Timestamp::TimeDiff _sendTime;
+
+	/** encoder policy and, for adaptive policy, the mode currently in use */
+	Options::EncoderMode _encoderMode;
+	Options::EncoderMode _encoderLevel;
+
+	/** adaptive policy state (mean encode time of each mode in microseconds) */
+	Poco::Timestamp::TimeDiff _encodeTimeAverage[Options::ENCODE_ADAPTIVE];
+	uint32_t _adaptivePacketCount;
+	uint32_t _adaptiveLateCount;
+
+	/** encoding activity (packets per mode, bytes in and out and time spent) */
+	uint32_t _encodeCount[Options::ENCODE_ADAPTIVE];
+	uint64_t _encodeBytesIn;
+	uint64_t _encodeBytesOut;
+	Poco::Timestamp::TimeDiff _encodeTime;
+	Poco::Timestamp::TimeDiff _encodeTimeMax;
+
+	/** send table, rebuilt whenever devices come, go or lose their connection
+	    and swapped in whole so that the sender can read it without locking */
+	std::shared_ptr<const SendTable> _sendTable;
 
 	volatile bool _stopSending;
+	MediaClock _mediaClock;
+	PacingTimer _pacingTimer;
+	Poco::Event _packetSent; // for writers waiting on space or drain
 	Poco::Thread _senderThread;
+	Poco::Event _encoderWakeup;
+	Poco::Thread _encoderThread;
+	Poco::RunnableAdapter<RAOPEngine> _encoderRunnable;
 	Poco::Thread _reactorThread;
 	Poco::Net::SocketReactor _socketReactor;
 
 	Poco::Observer<RAOPEngine,Poco::Net::ReadableNotification> _controlRequestHandler;
 	Poco::Observer<RAOPEngine,Poco::Net::ReadableNotification> _timingRequestHandler;
+	Poco::Observer<RAOPEngine,Poco::Net::ReadableNotification> _connectionReadableHandler;
+	Poco::Observer<RAOPEngine,Poco::Net::ErrorNotification> _connectionErrorHandler;
+	Poco::Observer<RAOPEngine,Poco::Net::TimeoutNotification> _reactorTimeoutHandler;
+
+	/** RTSP connections reactor saw close, for sender to confirm; reactor
+	    does not take engine's mutex over them, since removing their handlers
+	    under that mutex waits for any handler the reactor is running */
+	std::vector<Poco::Net::Socket> _closedConnections;
+	std::atomic<bool> _connectionClosed;
+	Poco::FastMutex _closedConnectionsMutex;
+
+	/** connections with a response waiting for the requesting thread to read
+	    it, and whether reactor has stopped watching them (reactor thread only) */
+	struct PendingResponse
+	{
+		Poco::Timestamp since;
+		bool paused;
+	};
+	std::map<Poco::Net::Socket, PendingResponse> _pendingResponses;
 
 	Poco::Net::DatagramSocket _controlSocket;
 	Poco::Net::DatagramSocket _timingSocket;
@@ -145,7 +286,7 @@ private:
 
 	OutputObserver& _outputObserver;
 
-	std::auto_ptr<class ALACEncoder> _alacEncoder;
+	std::auto_ptr<class ALACStreamEncoder> _alacEncoder;
 
 	typedef std::list<class RAOPDevice*> RAOPDeviceList;
 	RAOPDeviceList _raopDevices;
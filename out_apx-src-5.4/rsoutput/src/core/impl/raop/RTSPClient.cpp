@@ -24,9 +24,9 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cstring>
 #include <iterator>
 #include <map>
-#include <regex>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -35,6 +35,7 @@
 #include <openssl/rsa.h>
 #include <Poco/Format.h>
 #include <Poco/Mutex.h>
+#include <Poco/String.h>
 #include <Poco/StringTokenizer.h>
 #include <Poco/Timespan.h>
 #include <Poco/Net/NetException.h>
@@ -226,6 +227,7 @@ class RTSPClientImpl : private Uncopyable
 	RTSPResponse sendRequestReceiveResponse(RTSPRequest&);
 	void sendRequest(const buffer_t&);
 	std::string receiveResponse();
+	void receiveMore();
 
 	void parseAuthenticateHeader(const std::string&);
 	std::string buildAuthorizationHeader(
@@ -235,6 +237,10 @@ private:
 	FastMutex       _rtspMutex;
 	StreamSocket    _rtspSocket;
 
+	// bytes received but not yet consumed by a response
+	std::vector<char> _receiveBuffer;
+	size_t          _receiveLength;
+
 	bool            _teardownRequired;
 	uint32_t        _messageSequenceNumber;
 	uint32_t        _localSessionId;
@@ -296,6 +302,12 @@ bool RTSPClient::isReady() const
 }
 
 
+const StreamSocket& RTSPClient::socket() const
+{
+	return _impl->_rtspSocket;
+}
+
+
 void RTSPClient::setPassword(const std::string& password)
 {
 	_impl->_authenticationPassword = password;
@@ -736,7 +748,9 @@ RTSPClientImpl::RTSPClientImpl(StreamSocket& rtspSocket, const uint32_t& remoteC
 	_localSessionId(0),
 	_remoteSessionId(),
 	_remoteControlId(remoteControlId),
-	_rtspSocket(rtspSocket)
+	_rtspSocket(rtspSocket),
+	_receiveBuffer(4096),
+	_receiveLength(0)
 {
 	_rtspSocket.setBlocking(true);
 	_rtspSocket.setKeepAlive(true);
@@ -834,44 +848,87 @@ void RTSPClientImpl::sendRequest(const buffer_t& requestData)
 
 std::string RTSPClientImpl::receiveResponse()
 {
-	std::vector<char> responseBuffer(512);
-	size_t responseLength = 0;
-	int32_t lastFour = 0;
-	char octet;
-	int code;
+	size_t lineBegin = 0;
+	size_t headerLength = 0;
+	size_t contentLength = 0;
+	bool isStatusLine = true;
 
-	do
+	// examine each line as it completes until blank line ends the headers
+	while (headerLength == 0)
 	{
-		if (responseBuffer.size() == responseLength)
-			responseBuffer.resize(responseBuffer.size() * 2);
+		const char* const data = &_receiveBuffer[0];
+		const char* const lineEnd = static_cast<const char*>(
+			std::memchr(data + lineBegin, '\n', _receiveLength - lineBegin));
+		if (lineEnd == NULL)
+		{
+			receiveMore();
+			continue;
+		}
 
-		if ((code = _rtspSocket.receiveBytes(&octet, 1)) <= 0)
+		const size_t nextLine = (lineEnd - data) + 1;
+		size_t lineLength = (nextLine - 1) - lineBegin;
+		if (lineLength > 0 && data[lineBegin + lineLength - 1] == '\r')
 		{
-			throw std::runtime_error(
-				Poco::format("_rtspSocket.receiveBytes returned %i", code));
+			lineLength -= 1;
+		}
+
+		if (isStatusLine)
+		{
+			isStatusLine = false;
+		}
+		else if (lineLength == 0)
+		{
+			headerLength = nextLine;
+		}
+		else if (lineLength > CONTENT_LENGTH_HEADER.length()
+			&& data[lineBegin + CONTENT_LENGTH_HEADER.length()] == ':'
+			&& Poco::icompare(std::string(data + lineBegin, CONTENT_LENGTH_HEADER.length()),
+				CONTENT_LENGTH_HEADER) == 0)
+		{
+			std::string value(data + lineBegin + CONTENT_LENGTH_HEADER.length() + 1,
+				lineLength - CONTENT_LENGTH_HEADER.length() - 1);
+			contentLength = NumberParser::parseDecimalIntegerTo<size_t>(Poco::trim(value));
 		}
 
-		lastFour = (lastFour << 8) | octet;
-		responseBuffer[responseLength] = octet;
-		responseLength += static_cast<size_t>(code);
+		lineBegin = nextLine;
+	}
+
+	// read until complete response body is buffered
+	const size_t responseLength = headerLength + contentLength;
+	while (_receiveLength < responseLength)
+	{
+		receiveMore();
+	}
+
+	const std::string responseText(&_receiveBuffer[0], responseLength);
+
+	// keep any bytes beyond this response for the next one
+	_receiveLength -= responseLength;
+	if (_receiveLength > 0)
+	{
+		std::memmove(&_receiveBuffer[0], &_receiveBuffer[responseLength], _receiveLength);
 	}
-	while (lastFour != 0x0D0A0D0A); // read until "\r\n\r\n"
 
-	// read response body if content length is provided
-	std::tr1::match_results<std::vector<char>::iterator> mr;
-	if (std::tr1::regex_search(responseBuffer.begin(), responseBuffer.end(),
-							   mr, std::tr1::regex("\\bContent-Length:\\s*(\\d+)\r\n")))
+	return responseText;
+}
+
+
+void RTSPClientImpl::receiveMore()
+{
+	if (_receiveBuffer.size() - _receiveLength < 1024)
 	{
-		const size_t contentLength = NumberParser::parseDecimalIntegerTo<size_t>(mr[1]);
+		_receiveBuffer.resize(_receiveBuffer.size() * 2);
+	}
 
-		if (contentLength > responseBuffer.size() - responseLength) responseBuffer.resize(responseLength + contentLength);
-		code = _rtspSocket.receiveBytes(&responseBuffer[responseLength], contentLength);
-		assert(static_cast<size_t>(code) == contentLength);
-		responseLength += contentLength;
+	const int code = _rtspSocket.receiveBytes(&_receiveBuffer[_receiveLength],
+		static_cast<int>(_receiveBuffer.size() - _receiveLength));
+	if (code <= 0)
+	{
+		throw std::runtime_error(
+			Poco::format("_rtspSocket.receiveBytes returned %i", code));
 	}
 
-	assert(responseBuffer.size() >= responseLength);
-	return std::string(&responseBuffer[0], responseLength);
+	_receiveLength += static_cast<size_t>(code);
 }
 
 
@@ -34,6 +34,7 @@ public:
 	~RTSPClient();
 
 	bool isReady() const;
+	const Poco::Net::StreamSocket& socket() const;
 
 	void setPassword(const std::string&);
 
@@ -787,6 +787,16 @@ Options::SharedPtr OptionsDialogImpl::buildOptions() const
 
 	const Options::SharedPtr options = Options::getOptions();
 
+	// encoder mode, latency profile and downmix matrices are only set in ini
+	// file, so carry them over
+	opts->setEncoderMode(options->getEncoderMode());
+	opts->setLowLatency(options->getLowLatency());
+	opts->setRedundantAudio(options->getRedundantAudio());
+	for (int channelCount = 3; channelCount <= 8; ++channelCount)
+	{
+		opts->setDownmixMatrix(channelCount, options->getDownmixMatrix(channelCount));
+	}
+
 	// transfer passwords
 	for (DeviceInfoSet::const_iterator it = opts->devices().begin();
 		it != opts->devices().end(); ++it)
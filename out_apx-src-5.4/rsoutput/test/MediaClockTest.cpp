@@ -0,0 +1,211 @@
+/* Copyright (c) 2014  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Standalone verification of MediaClock against wall-clock jumps.
+ *
+ * Drives a MediaClock from stepped tick and wall-clock sources and paces packets
+ * of 352 samples off it the way RAOPEngine does, with the sender waking up to
+ * half a millisecond late.  Midway the wall clock steps an hour ahead and later
+ * an hour and a half back.  Checks that no packet is due early or more than the
+ * wake-up slack late, that mean cadence stays at 352 samples per packet, and
+ * that NTP time of each packet advances by exactly its tick time, whereas a
+ * clock constructed after the step does see it.  Finally checks that the
+ * performance counter never runs backwards.
+ *
+ * The MediaClockTest project in the solution builds this and runs it after
+ * each build, failing the build if a check fails.  To build it by hand (from
+ * this directory, after building Poco):
+ *	cl /O2 /EHsc /DNOMINMAX /DRSOUTPUT_EXPORTS /I..\sdk /I..\src\core\impl\raop
+ *		/I..\..\..\poco-1.6.0\Foundation\include MediaClockTest.cpp
+ *		..\src\core\impl\raop\MediaClock.cpp ..\src\core\impl\raop\NTPTimestamp.cpp
+ *		/link /LIBPATH:..\..\..\poco-1.6.0\lib
+ */
+
+#include "MediaClock.h"
+#include "NTPTimestamp.h"
+#include "Platform.h"
+#include <cstdio>
+#include <cstdlib>
+#include <Poco/Timestamp.h>
+
+
+static const int64_t SAMPLES_PER_PACKET = 352;
+static const int64_t SAMPLES_PER_SECOND = 44100;
+static const int PACKET_COUNT = 45000; // about 6 minutes
+
+// sender wakes up this late at most (in nanoseconds)
+static const MediaClock::Time WAKE_SLACK = 500000;
+
+// wall clock steps at these packets by these amounts (in microseconds)
+static const int FORWARD_STEP_PACKET = PACKET_COUNT / 3;
+static const int BACKWARD_STEP_PACKET = PACKET_COUNT * 2 / 3;
+static const Poco::Timestamp::TimeDiff FORWARD_STEP = 3600LL * 1000000;
+static const Poco::Timestamp::TimeDiff BACKWARD_STEP = -5400LL * 1000000;
+
+// NTP timestamps carry about a quarter of a nanosecond, but MediaClock maps
+// through microseconds
+static const MediaClock::Time NTP_TOLERANCE = 2 * MediaClock::NANOSECONDS_PER_MICROSECOND;
+
+
+//------------------------------------------------------------------------------
+// stepped clock sources
+
+
+// wall clock follows ticks from this offset until stepped
+static MediaClock::Time theTicks = 123456789;
+static Poco::Timestamp::TimeVal theWallOffset = 1400000000LL * 1000000;
+
+static MediaClock::Time steppedTicks()
+{
+	return theTicks;
+}
+
+static Poco::Timestamp steppedWallTime()
+{
+	return Poco::Timestamp(theWallOffset + theTicks / MediaClock::NANOSECONDS_PER_MICROSECOND);
+}
+
+static void advance(const MediaClock::Time nanoseconds)
+{
+	theTicks += nanoseconds;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+// as RAOPEngine::samplesToMediaTime
+static MediaClock::Time samplesToMediaTime(const int64_t samples)
+{
+	return (samples / SAMPLES_PER_SECOND) * MediaClock::NANOSECONDS_PER_SECOND
+		+ ((samples % SAMPLES_PER_SECOND) * MediaClock::NANOSECONDS_PER_SECOND) / SAMPLES_PER_SECOND;
+}
+
+
+static int64_t toNanoseconds(const NTPTimestamp& ntpTime)
+{
+	return static_cast<int64_t>(ntpTime.seconds) * MediaClock::NANOSECONDS_PER_SECOND
+		+ ((static_cast<int64_t>(ntpTime.fractionalSeconds) * MediaClock::NANOSECONDS_PER_SECOND) >> 32);
+}
+
+
+static bool testWallClockSteps()
+{
+	const MediaClock mediaClock(steppedTicks, steppedWallTime);
+
+	// simple linear congruential generator, so runs are repeatable
+	uint32_t random = 12345;
+
+	const MediaClock::Time baseTime = mediaClock.now();
+	MediaClock::Time lastSendTime = baseTime;
+	NTPTimestamp lastNTPTime = mediaClock.toNTPTimestamp(baseTime);
+
+	MediaClock::Time lateMax = 0;
+	MediaClock::Time gapMax = 0;
+	int earlyCount = 0;
+	int ntpMismatchCount = 0;
+	bool stepSeen = false;
+
+	for (int packet = 1; packet <= PACKET_COUNT; ++packet)
+	{
+		if (packet == FORWARD_STEP_PACKET) theWallOffset += FORWARD_STEP;
+		if (packet == BACKWARD_STEP_PACKET) theWallOffset += BACKWARD_STEP;
+
+		// sender waits for due time of packet, then wakes up a little late
+		const MediaClock::Time dueTime = baseTime + samplesToMediaTime(packet * SAMPLES_PER_PACKET);
+		random = random * 1103515245 + 12345;
+		const MediaClock::Time wakeTime = dueTime + (random >> 8) % WAKE_SLACK;
+		advance(wakeTime - mediaClock.now());
+
+		const MediaClock::Time sendTime = mediaClock.now();
+		if (sendTime < dueTime)
+		{
+			earlyCount += 1;
+		}
+		if (sendTime - dueTime > lateMax) lateMax = sendTime - dueTime;
+		if (sendTime - lastSendTime > gapMax) gapMax = sendTime - lastSendTime;
+
+		// devices must see time advance just as the stream does
+		const NTPTimestamp ntpTime = mediaClock.toNTPTimestamp(sendTime);
+		const int64_t ntpElapsed = toNanoseconds(ntpTime) - toNanoseconds(lastNTPTime);
+		if (std::llabs(ntpElapsed - (sendTime - lastSendTime)) > NTP_TOLERANCE)
+		{
+			ntpMismatchCount += 1;
+		}
+
+		if (packet == FORWARD_STEP_PACKET)
+		{
+			// a clock taken now would be an hour off, so the step is there to see
+			const MediaClock laterClock(steppedTicks, steppedWallTime);
+			const Poco::Timestamp::TimeDiff offset =
+				laterClock.toTimestamp(sendTime) - mediaClock.toTimestamp(sendTime);
+			stepSeen = (std::llabs(offset - FORWARD_STEP) <= 1);
+		}
+
+		lastSendTime = sendTime;
+		lastNTPTime = ntpTime;
+	}
+
+	const double cadence = static_cast<double>(lastSendTime - baseTime) / PACKET_COUNT / 1000.0;
+	const double expected = static_cast<double>(SAMPLES_PER_PACKET) * 1000000.0 / SAMPLES_PER_SECOND;
+
+	std::printf("%d packets across wall-clock steps of %+lld s and %+lld s:\n",
+		PACKET_COUNT, static_cast<long long>(FORWARD_STEP / 1000000),
+		static_cast<long long>(BACKWARD_STEP / 1000000));
+	std::printf("  cadence %.3f us (expected %.3f us); max gap %.3f ms; max lateness %.3f ms\n",
+		cadence, expected, gapMax / 1.0e6, lateMax / 1.0e6);
+	std::printf("  %d early packet(s); %d NTP step(s) off tick time; step %s to new clock\n",
+		earlyCount, ntpMismatchCount, stepSeen ? "visible" : "NOT visible");
+
+	return earlyCount == 0 && ntpMismatchCount == 0 && stepSeen
+		&& lateMax < WAKE_SLACK
+		&& gapMax < samplesToMediaTime(SAMPLES_PER_PACKET) + WAKE_SLACK
+		&& cadence > expected - 0.5 && cadence < expected + 0.5;
+}
+
+
+static bool testPerformanceCounter()
+{
+	int backwardCount = 0;
+
+	MediaClock::Time lastTime = MediaClock::performanceCounter();
+	for (int i = 0; i < 1000000; ++i)
+	{
+		const MediaClock::Time time = MediaClock::performanceCounter();
+		if (time < lastTime)
+		{
+			backwardCount += 1;
+		}
+		lastTime = time;
+	}
+
+	std::printf("performance counter: %d backward step(s) in 1000000 reads\n", backwardCount);
+
+	return backwardCount == 0;
+}
+
+
+int main()
+{
+	bool passed = true;
+
+	passed = testWallClockSteps() && passed;
+	passed = testPerformanceCounter() && passed;
+
+	std::printf(passed ? "media clock verified\n" : "VERIFICATION FAILED\n");
+	return passed ? 0 : 1;
+}
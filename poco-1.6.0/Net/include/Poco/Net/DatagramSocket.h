@@ -102,6 +102,15 @@ public:
 		/// Returns the number of bytes sent, which may be
 		/// less than the number of bytes specified.
 
+	int sendToMany(const void* buffer, int length, const SocketAddress* addresses, int count, int flags = 0);
+		/// Sends the contents of the given buffer through
+		/// the socket to each of the given addresses, batching
+		/// the datagrams into a single system call where the
+		/// platform supports it.
+		///
+		/// Returns the number of datagrams sent, which may be
+		/// less than count.
+
 	int receiveFrom(void* buffer, int length, SocketAddress& address, int flags = 0);
 		/// Receives data from the socket and stores it
 		/// in buffer. Up to length bytes are received.
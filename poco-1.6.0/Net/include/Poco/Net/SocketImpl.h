@@ -152,6 +152,17 @@ public:
 		/// Returns the number of bytes sent, which may be
 		/// less than the number of bytes specified.
 	
+	virtual int sendToMany(const void* buffer, int length, const SocketAddress* addresses, int count, int flags = 0);
+		/// Sends the contents of the given buffer through
+		/// the socket to each of the given addresses, using
+		/// as few system calls as the platform allows
+		/// (sendmmsg() on Linux, one sendto() per address elsewhere).
+		///
+		/// Returns the number of datagrams sent, which may be
+		/// less than count if sending to an address fails after
+		/// sending to earlier ones succeeded. Throws if no
+		/// datagram could be sent.
+	
 	virtual int receiveFrom(void* buffer, int length, SocketAddress& address, int flags = 0);
 		/// Receives data from the socket and stores it
 		/// in buffer. Up to length bytes are received.
@@ -101,6 +101,12 @@ int DatagramSocket::sendTo(const void* buffer, int length, const SocketAddress&
 }
 
 
+int DatagramSocket::sendToMany(const void* buffer, int length, const SocketAddress* addresses, int count, int flags)
+{
+	return impl()->sendToMany(buffer, length, addresses, count, flags);
+}
+
+
 int DatagramSocket::receiveFrom(void* buffer, int length, SocketAddress& address, int flags)
 {
 	return impl()->receiveFrom(buffer, length, address, flags);
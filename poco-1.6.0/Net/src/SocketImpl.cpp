@@ -331,6 +331,66 @@ int SocketImpl::sendTo(const void* buffer, int length, const SocketAddress& addr
 }
 
 
+int SocketImpl::sendToMany(const void* buffer, int length, const SocketAddress* addresses, int count, int flags)
+{
+	poco_assert (count >= 0);
+	poco_assert (addresses != 0 || count == 0);
+
+	int sent = 0;
+#if POCO_OS == POCO_OS_LINUX && defined(MSG_WAITFORONE)
+	// Feature test for sendmmsg(): glibc declares MSG_WAITFORONE together with
+	// sendmmsg() and recvmmsg(), so its presence means sendmmsg() is available.
+	// Without it, and on every other platform including Windows (which has no
+	// call that sends more than one datagram), each address costs one sendto().
+	static const int MAX_BATCH = 64;
+	struct iovec iov;
+	iov.iov_base = const_cast<void*>(buffer);
+	iov.iov_len  = length;
+	struct mmsghdr msgs[MAX_BATCH];
+	while (sent < count)
+	{
+		int batch = count - sent < MAX_BATCH ? count - sent : MAX_BATCH;
+		memset(msgs, 0, batch*sizeof(struct mmsghdr));
+		for (int i = 0; i < batch; ++i)
+		{
+			msgs[i].msg_hdr.msg_name    = const_cast<struct sockaddr*>(addresses[sent + i].addr());
+			msgs[i].msg_hdr.msg_namelen = addresses[sent + i].length();
+			msgs[i].msg_hdr.msg_iov     = &iov;
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+		}
+		int rc;
+		do
+		{
+			if (_sockfd == POCO_INVALID_SOCKET) throw InvalidSocketException();
+			rc = ::sendmmsg(_sockfd, msgs, batch, flags);
+		}
+		while (_blocking && rc < 0 && lastError() == POCO_EINTR);
+		if (rc < 0)
+		{
+			if (sent > 0) break;
+			error();
+		}
+		sent += rc;
+		if (rc < batch) break;
+	}
+#else
+	for (; sent < count; ++sent)
+	{
+		try
+		{
+			sendTo(buffer, length, addresses[sent], flags);
+		}
+		catch (Poco::Exception&)
+		{
+			if (sent > 0) break;
+			throw;
+		}
+	}
+#endif
+	return sent;
+}
+
+
 int SocketImpl::receiveFrom(void* buffer, int length, SocketAddress& address, int flags)
 {
 #if defined(POCO_BROKEN_TIMEOUTS)
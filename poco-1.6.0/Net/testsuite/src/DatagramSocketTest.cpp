@@ -78,6 +78,37 @@ void DatagramSocketTest::testSendToReceiveFrom()
 }
 
 
+void DatagramSocketTest::testSendToMany()
+{
+	UDPEchoServer echoServer1(SocketAddress("localhost", 0));
+	UDPEchoServer echoServer2(SocketAddress("localhost", 0));
+	DatagramSocket ss;
+	SocketAddress addresses[2] =
+	{
+		SocketAddress("localhost", echoServer1.port()),
+		SocketAddress("localhost", echoServer2.port())
+	};
+	int n = ss.sendToMany("hello", 5, addresses, 2);
+	assert (n == 2);
+	bool echoed1 = false;
+	bool echoed2 = false;
+	char buffer[256];
+	for (int i = 0; i < 2; ++i)
+	{
+		SocketAddress sa;
+		n = ss.receiveFrom(buffer, sizeof(buffer), sa);
+		assert (n == 5);
+		assert (std::string(buffer, n) == "hello");
+		if (sa.port() == echoServer1.port()) echoed1 = true;
+		if (sa.port() == echoServer2.port()) echoed2 = true;
+	}
+	assert (echoed1 && echoed2);
+	n = ss.sendToMany("hello", 5, addresses, 0);
+	assert (n == 0);
+	ss.close();
+}
+
+
 void DatagramSocketTest::testBroadcast()
 {
 	UDPEchoServer echoServer;
@@ -136,6 +167,7 @@ CppUnit::Test* DatagramSocketTest::suite()
 
 	CppUnit_addTest(pSuite, DatagramSocketTest, testEcho);
 	CppUnit_addTest(pSuite, DatagramSocketTest, testSendToReceiveFrom);
+	CppUnit_addTest(pSuite, DatagramSocketTest, testSendToMany);
 #if (POCO_OS != POCO_OS_FREE_BSD) // works only with local net bcast and very randomly
 	CppUnit_addTest(pSuite, DatagramSocketTest, testBroadcast);
 #endif
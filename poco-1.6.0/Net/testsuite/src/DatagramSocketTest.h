@@ -28,6 +28,7 @@ public:
 
 	void testEcho();
 	void testSendToReceiveFrom();
+	void testSendToMany();
 	void testBroadcast();
 
 	void setUp();